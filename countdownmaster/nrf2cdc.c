@@ -36,7 +36,9 @@
 //
 // Operating Instructions:
 // -----------------------
-// Plug the device into a USB port, it should be detected as a CDC device. Open a 
+// Plug the device into a USB port, it should be detected as a CDC device. With
+// SERIAL_CHIP_ID its USB serial number is the unique chip ID in hex, so several
+// sticks on one host keep stable names (e.g. /dev/serial/by-id). Open a 
 // serial monitor, BAUD rate doesn't matter. Enter the text to be sent, terminated
 // with a Newline (NL or '\ n'). A string that begins with an exclamation mark ('!')
 // is recognized as a command. The command is given by the letter following the
@@ -49,10 +51,72 @@
 //  t   set TX address    !t7B271F1F1F    addresses are 5 bytes, LSB first
 //  r   set RX address    !r41C355AA55    addresses are 5 bytes, LSB first
 //  s   set speed         !s02            data rate (00:250kbps, 01:1Mbps, 02:2Mbps)
+// scan scan channels     !scan           print carrier hits per channel
+// stat statistics        !stat           print link statistics per slave
+//  a   start all         !a05            start all slaves 5 seconds from now
+// bin binary mode        !bin            switch to SLIP framed binary packets
+// add register slave     !add12          poll slave 0x12 from now on
+// poll poll period       !poll0A         poll a slave every 0x0A * 10ms (00: off)
+// beac beacon period     !beac14         time beacon every 0x14 * 100ms (00: off)
+// snap snapshot          !snap           print cached status and time per slave
+// fleet fleet status     !fleet          broadcast hello, collect slotted replies
+// usb  USB upload mode   !usb01          01: throughput, 00: flush per packet
+// bench USB benchmark    !bench          upload BENCH_KB KiB, print time in ms
+//
+// The channel scan listens SCAN_SAMPLES times on each of the 126 channels and prints
+// how often the received power detector saw a carrier above -64dBm, as one 2-digit
+// hex count per channel in rows of 32 channels, followed by the quietest channel.
+//
+// The statistics list every slave the master has sent frames to with the number of
+// acknowledged frames, retransmissions, frames lost after 15 retries, the time in
+// ms from start of the last batch until its ACK, and the time in ms from the last
+// request until the slave's reply frame arrived (all values hex), followed by the
+// link level (0:250kbps, 1:1Mbps, 2:2Mbps, 3:2Mbps at -6dBm). With LINK_ADAPT the
+// master moves each slave up a level while it needs almost no retransmissions and
+// down when it needs many; slaves are told about data rate changes beforehand.
+//
+// Once enabled with "!pollXX" the master polls every known slave in turn for hello
+// status and time on its own and caches the replies instead of passing them on to
+// the host; "!snap" prints ID, status, seconds and the age of the values in 100ms
+// (FF: no reply yet) for all of them at once. "!fleet" asks all slaves at once
+// with a broadcast hello; each slave answers in a time slot derived from its ID,
+// and after the last slot the master prints the number of replies, the slots that
+// stayed silent and the cached slave states.
+//
+// Once enabled with "!beacXX" the master broadcasts its wall clock (seconds and
+// milliseconds) every XX * 100ms (BEACON_PERIOD at power-up, 0: off). Slaves lock
+// their own clock to it, so their countdowns tick in step. "!aXX" sends a beacon
+// and schedules the start for a master second XX seconds ahead (2-60), so all
+// slaves start at the same instant however late the frame reached them.
+//
+// By default every received payload is uploaded to the host at once. In throughput
+// mode ("!usb01") the master collects everything received during a 1ms USB frame
+// and uploads it in one packet at the next start of frame, which saves bus and
+// host interrupt load at high packet rates. "!usb" and the settings printout show
+// the mode, the flush requests, uploaded packets and bytes since the last printout
+// with the average bytes per packet, and the bytes lost to a full USB FIFO.
+// "!bench" uploads BENCH_KB KiB of 32-byte text lines the way received payloads
+// are forwarded (block write plus flush) as fast as the host takes them and
+// prints the time it took; tools/cdcbench.py runs it and reports KiB/s measured
+// on both ends, so builds can be compared on the same host.
 //
 // Enter just the exclamation mark ('!') for the actual NRF settings to be printed
 // in the serial monitor. The selected settings are saved in the data flash and are
 // retained even after a restart.
+//
+// Data made up of complete 8-byte countdown protocol frames (or 9-byte v2 frames) is
+// packed into payloads of up to AGGREGATE frames, even for different slaves, as
+// long as these listen at the same data rate; slaves handle every frame in a
+// payload addressed to them. Up to three payloads go out per transmission. Frames
+// addressed to all slaves (TO = 0) are sent without requesting an ACK. A payload
+// holding a single v2 frame that gets no ACK is sent again up to TX_RESEND times,
+// since slaves ignore the repetition of a v2 frame they have already applied.
+//
+// With HOST_NOTIFY the master reports radio events as SERIAL_STATE notifications
+// on the interrupt endpoint, so a host daemon can sleep on line changes (e.g.
+// TIOCMIWAIT) instead of polling the data pipe: DCD while received data waits for
+// the host, RI while a slave asks for help (help frame or hello status) and DSR
+// while a slave's time is up. Slave states count until POLL_STALE ms old.
 
 
 // ===================================================================================
@@ -67,6 +131,8 @@
 #include "src/flash.h"                    // data flash functions
 #include "src/usb_cdc.h"                  // USB-CDC serial functions
 #include "src/nrf24l01.h"                 // nRF24L01+ functions
+#include "src/protocol.h"                 // countdown protocol definitions
+#include "src/tick.h"                     // millisecond tick functions
 
 // Prototypes for used interrupts
 void USB_interrupt(void);
@@ -74,9 +140,115 @@ void USB_ISR(void) __interrupt(INT_NO_USB) {
   USB_interrupt();
 }
 
+void TICK_interrupt(void);
+void TICK_ISR(void) __interrupt(INT_NO_TMR2) {
+  TICK_interrupt();
+}
+
+#if NRF_IRQ_RX
+void NRF_interrupt(void);
+void NRF_ISR(void) __interrupt(INT_NO_INT1) {
+  NRF_interrupt();
+}
+#endif
+
 // Global variables
 __xdata uint8_t buffer[NRF_PAYLOAD];      // rx/tx buffer
 
+// Slave statistics, one entry per slave ID the master has sent frames to
+typedef struct _SLAVE_STAT {
+  uint8_t  id;                            // slave ID (P_TO), 0: entry unused
+  uint8_t  waiting;                       // request sent, reply not yet seen
+  uint16_t sent;                          // frames acknowledged by slave
+  uint16_t retries;                       // automatic retransmissions (ARC_CNT)
+  uint16_t fails;                         // frames lost after MAX_RT
+  uint16_t rtt;                           // ms from start of batch until its ACK
+  uint16_t latency;                       // ms from last request until reply frame
+  uint16_t asked;                         // timestamp of last request
+  uint8_t  cached;                        // POLL_* bits of valid cached values
+  uint16_t status;                        // last hello reply (MSG_HIGH, MSG_LOW)
+  uint16_t seconds;                       // last time reply in seconds
+  uint16_t seen;                          // timestamp of last reply frame
+  #if LINK_ADAPT
+  uint8_t  level;                         // LINK_* level frames are sent with
+  uint8_t  target;                        // level to switch to
+  uint8_t  window;                        // acknowledged frames in current window
+  uint8_t  windowRetries;                 // retransmits in current window
+  #endif
+} SLAVE_STAT;
+
+__xdata SLAVE_STAT stats[STAT_SLAVES];    // statistics table
+__xdata uint8_t statBatch[3];             // table entry for each frame in TX batch
+#if TX_RESEND
+__xdata uint8_t statFrames[3][PROTOCOL_LENGTH_V2]; // copy of each frame in TX batch
+__xdata uint8_t statLen[3];               // length of each copy, 0: none kept
+__xdata uint8_t statRound = 0;            // resends of current batch
+#endif
+__xdata uint8_t statReq[3];               // binary request ID for each frame in TX batch
+__xdata uint8_t statReplies = 0;          // frames in TX batch (bits) with binary reply
+__xdata uint8_t statQueued = 0;           // frames in TX batch
+__xdata uint16_t statStart;               // timestamp of batch start
+__xdata uint8_t statLevel;                // link level of frames in TX batch
+__bit statBusy = 0;                       // batch on air, statistics pending
+
+#if LINK_ADAPT
+// Link levels from robust to fast: data rate (NRF_speed index) and power (NRF_power
+// index); a slave only needs to be told about data rate changes
+__code uint8_t LINK_SPEED[] = {0, 1, 2, 2};
+__code uint8_t LINK_POWER[] = {3, 3, 3, 2};  // 0dBm, last level 2M at -6dBm
+#define LINK_LEVELS       sizeof(LINK_SPEED)
+__xdata uint8_t linkBase;                 // level matching NRF_speed, slaves fall back to it
+#endif
+
+__xdata uint8_t masterFrame[2*PROTOCOL_LENGTH]; // frames sent by the master itself
+__xdata uint16_t beaconPeriod = BEACON_PERIOD; // ms between time beacons, 0: off
+__xdata uint16_t beaconLast = 0;          // timestamp of last time beacon
+
+// Poll scheduler
+#define POLL_STATUS       0x01            // cached hello status valid
+#define POLL_TIME         0x02            // cached time valid
+__xdata uint16_t pollPeriod = POLL_PERIOD;// ms between polls, 0: off
+__xdata uint16_t pollLast = 0;            // timestamp of last poll
+__xdata uint8_t pollNext = 0;             // table entry to poll next
+
+// Fleet collection (broadcast hello, replies in TDMA slots)
+#define FLEET_WINDOW      (P_SLOT_BASE + (P_SLOTS + 1) * P_SLOT_MS) // ms until last slot is over
+__xdata uint16_t fleetStart;              // timestamp of fleet broadcast
+__xdata uint16_t fleetSeen;               // slots (bits) a reply arrived in
+__xdata uint8_t fleetReplies;             // reply payloads during collection
+__xdata uint8_t fleetReq;                 // binary request ID
+__bit fleetBusy = 0;                      // collecting replies
+__bit fleetBin  = 0;                      // report as binary packet
+
+// Radio events signalled to the host via SERIAL_STATE notifications
+#define NOTE_RX           CDC_STATE_DCD   // received data waiting for host
+#define NOTE_TIME         CDC_STATE_DSR   // a slave's time is up
+#define NOTE_HELP         CDC_STATE_RI    // a slave asks for help
+
+// Binary host protocol (SLIP framed packets)
+#define BIN_END           0xC0            // SLIP packet delimiter
+#define BIN_ESC           0xDB            // SLIP escape
+#define BIN_ESC_END       0xDC            // escaped BIN_END
+#define BIN_ESC_ESC       0xDD            // escaped BIN_ESC
+#define BIN_HEADER        4               // type, request ID, dest/status, length
+#define BIN_SEND          0x01            // host: send payload to dest, reply status
+#define BIN_SNAPSHOT      0x02            // host: request cached slave states
+#define BIN_FLEET         0x03            // host: collect status of all slaves
+#define BIN_EXIT          0x0F            // host: return to text mode
+#define BIN_STATUS        0x81            // master: result of BIN_SEND request
+#define BIN_RECEIVE       0x82            // master: payload received via NRF
+#define BIN_SLAVES        0x83            // master: cached slave states
+#define BIN_FLEET_DONE    0x84            // master: slots a reply arrived in
+#define BIN_OK            0x00            // payload sent (and acknowledged)
+#define BIN_FAIL          0x01            // no ACK after all retransmits
+#define BIN_DROPPED       0x02            // not sent, earlier payload in batch failed
+#define BIN_BAD_LENGTH    0x03            // length field doesn't match packet
+#define BIN_BAD_TYPE      0x04            // unknown packet type
+__xdata uint8_t binBuf[BIN_HEADER + NRF_PAYLOAD]; // decoded packet from host
+__xdata uint8_t binLen = 0;               // bytes in binBuf, 0xFF: overflow
+__bit binMode = 0;                        // binary host protocol active
+__bit binEsc  = 0;                        // last byte was BIN_ESC
+
 // ===================================================================================
 // Print Functions and String Conversions
 // ===================================================================================
@@ -93,6 +265,12 @@ void CDC_printByte(uint8_t value) {
   CDC_printNibble (value & 0x0F);
 }
 
+// Convert word into hex string and print via CDC
+void CDC_printWord(uint16_t value) {
+  CDC_printByte(value >> 8);
+  CDC_printByte(value);
+}
+
 // Convert an array of bytes into hex string and print via CDC
 void CDC_printBytes(uint8_t *ptr, uint8_t len) {
   while(len--) CDC_printByte(*ptr++);
@@ -120,8 +298,65 @@ void hexAddress(uint8_t *sptr, uint8_t *aptr) {
   }
 }
 
+// Print USB upload mode and counters since last printout via CDC
+void CDC_printUSB(void) {
+  uint16_t flushes, packets, bytes;
+  CDC_ATOMIC_BLOCK {
+    flushes = CDC_txFlushes;                        // counted in USB interrupt too
+    packets = CDC_txPackets;
+    bytes   = CDC_txBytes;
+    CDC_txFlushes = 0;
+    CDC_txPackets = 0;
+    CDC_txBytes   = 0;
+  }
+  CDC_print  ("# USB mode: ");   CDC_println(CDC_coalesce ? "throughput" : "flush");
+  CDC_print  ("# USB flushes: "); CDC_printWord(flushes);
+  CDC_print  (" packets: ");     CDC_printWord(packets);
+  CDC_print  (" bytes: ");       CDC_printWord(bytes);
+  CDC_print  (" avg: ");         CDC_printByte(packets ? bytes / packets : 0);
+  CDC_write('\n');
+  CDC_print  ("# USB dropped: "); CDC_printWord(CDC_txDropped);
+  CDC_print  (" peak: ");        CDC_printByte(CDC_txPeak);       CDC_write('\n');
+}
+
+// Upload BENCH_KB KiB of text lines like forwarded payloads, print time in ms
+void CDC_bench(void) {
+  uint16_t left = BENCH_KB * 1024;                  // bytes still to upload
+  uint16_t dropped = CDC_txDropped;
+  uint16_t start, spins = 0;
+  uint8_t i, len;
+  for(i=0; i<NRF_PAYLOAD; i++) buffer[i] = 'A' + (i & 0x0F);
+  buffer[NRF_PAYLOAD - 1] = '\n';
+  start = TICK_now();
+  while(left) {
+    WDT_reset();
+    if(CDC_free() < NRF_PAYLOAD) {                  // host hasn't taken the last ones
+      CDC_flush();
+      if(!CDC_getDTR() || !++spins) break;          // port closed or host stopped reading
+      continue;
+    }
+    spins = 0;
+    len = (left < NRF_PAYLOAD) ? left : NRF_PAYLOAD;
+    CDC_writeBlock(buffer, len);                    // same path as received payloads
+    CDC_flush();
+    left -= len;
+  }
+  start = TICK_now() - start;
+  CDC_print  ("\n# USB bench KiB: "); CDC_printByte(BENCH_KB);
+  CDC_print  (" ms: ");          CDC_printWord(start);
+  CDC_print  (" left: ");        CDC_printWord(left);
+  CDC_print  (" dropped: ");     CDC_printWord(CDC_txDropped - dropped);
+  CDC_write('\n');
+  CDC_flush();
+}
+
 // Print the current NRF settings via CDC
 void CDC_printSettings(void) {
+  uint16_t spi;
+  NRF_ATOMIC_BLOCK {
+    spi = NRF_spiCount;                             // SPI transactions since last printout
+    NRF_spiCount = 0;
+  }
   CDC_println("# nRF24L01+ Configuration:");
   CDC_print  ("# Master ID: ");  CDC_printByte(NRF_id);           CDC_write('\n');
   CDC_print  ("# RF channel: "); CDC_printByte(NRF_channel);      CDC_write('\n');
@@ -129,7 +364,8 @@ void CDC_printSettings(void) {
   CDC_print  ("# RX address: "); CDC_printBytes(NRF_rx_addr, 5);  CDC_write('\n');
   CDC_print  ("# Data rate:  "); CDC_print(NRF_STR[NRF_speed]);   CDC_println("bps");
   CDC_print  ("# Power rate: "); CDC_print(NRF_STR_PW[NRF_power]);CDC_println("bBm");
-  
+  CDC_print  ("# SPI transfers: "); CDC_printWord(spi); CDC_write('\n');
+  CDC_printUSB();
 }
 
 // ===================================================================================
@@ -182,6 +418,17 @@ void printHelp(){
   CDC_println("!rXXXXXX - change receive address");
   CDC_println("!sXX     - change speed");
   CDC_println("!pXX     - change power");
+  CDC_println("!scan    - scan channels");
+  CDC_println("!stat    - prints slave statistics");
+  CDC_println("!aXX     - start all slaves in XX seconds");
+  CDC_println("!bin     - switch to binary mode");
+  CDC_println("!addXX   - register slave XX for polling");
+  CDC_println("!pollXX  - poll a slave every XX*10ms (00: off)");
+  CDC_println("!beacXX  - time beacon every XX*100ms (00: off)");
+  CDC_println("!snap    - prints cached slave states");
+  CDC_println("!fleet   - collect status of all slaves");
+  CDC_println("!usbXX   - USB mode 01: throughput, 00: flush");
+  CDC_println("!bench   - USB throughput benchmark");
 }
 
 // Prints ID
@@ -190,11 +437,797 @@ void printID(){
   CDC_flush(); 
 }
 
+// ===================================================================================
+// Master Frames
+// ===================================================================================
+
+// Fill a time beacon with the current wall clock
+void fillBeacon(__xdata uint8_t *frame) {
+  uint16_t phase;
+  uint8_t  seconds;
+  TICK_ATOMIC_BLOCK {
+    phase   = TICK_phase;
+    seconds = TICK_seconds;
+  }
+  P_fill(frame, BROADCAST_ID, MASTER_ID, P_CODE_BEACON, (seconds << 2) | (phase >> 8), phase);
+}
+
+// ===================================================================================
+// Binary Host Protocol - Output
+// ===================================================================================
+
+// Write byte SLIP escaped via CDC
+void BIN_write(uint8_t value) {
+  if(value == BIN_END) {
+    CDC_write(BIN_ESC);
+    value = BIN_ESC_END;
+  }
+  else if(value == BIN_ESC) {
+    CDC_write(BIN_ESC);
+    value = BIN_ESC_ESC;
+  }
+  CDC_write(value);
+}
+
+// Start packet to host with header, data follows via BIN_write()
+void BIN_begin(uint8_t type, uint8_t req, uint8_t status, uint8_t len) {
+  CDC_write(BIN_END);
+  BIN_write(type);
+  BIN_write(req);
+  BIN_write(status);
+  BIN_write(len);
+}
+
+// Finish packet to host
+void BIN_end(void) {
+  CDC_write(BIN_END);
+  CDC_flush();
+}
+
+// Send packet to host: header and data
+void BIN_packet(uint8_t type, uint8_t req, uint8_t status, __xdata uint8_t *data, uint8_t len) {
+  BIN_begin(type, req, status, len);
+  while(len--) BIN_write(*data++);
+  BIN_end();
+}
+
+// Report result of a BIN_SEND request, data is the number of retransmits
+void BIN_status(uint8_t req, uint8_t status, uint8_t retries) {
+  binBuf[BIN_HEADER] = retries;
+  BIN_packet(BIN_STATUS, req, status, binBuf + BIN_HEADER, 1);
+}
+
+// ===================================================================================
+// Slave Statistics
+// ===================================================================================
+
+// Get statistics table entry for slave ID, allocate one if new; 0xFF if full
+uint8_t STAT_entry(uint8_t id) {
+  uint8_t i;
+  for(i=0; i<STAT_SLAVES; i++) {
+    if(stats[i].id == id) return i;                 // known slave
+    if(!stats[i].id) {                              // free entry -> take it
+      stats[i].id = id;
+      #if LINK_ADAPT
+      stats[i].level  = linkBase;
+      stats[i].target = linkBase;
+      #endif
+      return i;
+    }
+  }
+  return 0xFF;
+}
+
+// ===================================================================================
+// Link Adaption
+// ===================================================================================
+// Every slave starts at the level of the configured data rate and power. After
+// LINK_WINDOW acknowledged frames the master steps one level up if there were at
+// most LINK_UP_RETRIES retransmits, or one level down if there were at least
+// LINK_DOWN_RETRIES. Before a data rate change the slave is told with a P_CODE_RATE
+// frame at the old rate; only when that is acknowledged does the master switch too.
+// Slaves always answer at the configured rate, so the master keeps listening there.
+// If a slave is lost (MAX_RT) the master falls back to the configured rate at once;
+// the slave does the same when it hears nothing from the master for a while.
+
+#if LINK_ADAPT
+// RF_SETUP for a link level (the base level keeps the configured power)
+uint8_t LINK_setup(uint8_t level) {
+  if(level == linkBase) return NRF_rxSetup;
+  return(NRF_SETUP[LINK_SPEED[level]] | NRF_POWER[LINK_POWER[level]]);
+}
+
+// Get level frames to slave ID are sent with
+uint8_t LINK_level(uint8_t id) {
+  uint8_t e;
+  if(id == BROADCAST_ID) return linkBase;
+  e = STAT_entry(id);
+  return (e == 0xFF) ? linkBase : stats[e].level;
+}
+
+// Reset all links to the configured data rate and power
+void LINK_reset(void) {
+  uint8_t i;
+  linkBase = NRF_speed;                             // levels 0-2 are full power
+  for(i=0; i<STAT_SLAVES; i++) {
+    stats[i].level  = linkBase;
+    stats[i].target = linkBase;
+    stats[i].window = 0;
+    stats[i].windowRetries = 0;
+  }
+}
+
+// Account acknowledged frame with arc retransmits
+void LINK_update(uint8_t e, uint8_t arc) {
+  uint8_t level = stats[e].level;
+  stats[e].windowRetries += arc;
+  if(++stats[e].window < LINK_WINDOW) return;
+  if((stats[e].windowRetries <= LINK_UP_RETRIES) && (level < LINK_LEVELS - 1)) level++;
+  else if((stats[e].windowRetries >= LINK_DOWN_RETRIES) && level) level--;
+  stats[e].target = level;
+  stats[e].window = 0;
+  stats[e].windowRetries = 0;
+}
+
+// Slave did not acknowledge: fall back to configured rate
+void LINK_lost(uint8_t e) {
+  stats[e].level  = linkBase;
+  stats[e].target = linkBase;
+  stats[e].window = 0;
+  stats[e].windowRetries = 0;
+}
+
+#else
+#define LINK_level(id)    0
+#define LINK_service()
+#define LINK_update(e, arc)
+#define LINK_lost(e)
+#endif
+
+// Remember destination (and a copy) of frame just queued for the next batch
+void STAT_queue(uint8_t id, __xdata uint8_t *frame, uint8_t len) {
+  #if TX_RESEND
+  uint8_t i;
+  statLen[statQueued] = 0;
+  if(len <= PROTOCOL_LENGTH_V2) {
+    for(i=0; i<len; i++) statFrames[statQueued][i] = frame[i];
+    statLen[statQueued] = len;
+  }
+  #else
+  (void)frame; (void)len;
+  #endif
+  statBatch[statQueued++] = (id == BROADCAST_ID) ? 0xFF : STAT_entry(id);
+}
+
+// Start transmitting queued frames
+void STAT_send(void) {
+  uint8_t i, e;
+  if(!statQueued || statBusy) return;
+  statStart = TICK_now();
+  for(i=0; i<statQueued; i++) {
+    e = statBatch[i];
+    if(e == 0xFF) continue;
+    stats[e].asked   = statStart;                   // request goes out now
+    stats[e].waiting = 1;
+  }
+  statBusy = 1;
+  #if LINK_ADAPT
+  NRF_txSetup = LINK_setup(statLevel);              // rate/power for this slave
+  #endif
+  NRF_sendQueued();
+}
+
+// Account frame i of finished batch: acknowledged, hit MAX_RT or dropped after it
+void STAT_account(uint8_t i, uint16_t rtt) {
+  uint8_t e;
+  if(statReplies & (1 << i)) {                      // binary request?
+    BIN_status(statReq[i], (i < NRF_txSent) ? BIN_OK : (i == NRF_txSent) ? BIN_FAIL : BIN_DROPPED,
+               (i <= NRF_txSent) ? NRF_txArc[i] : 0);
+  }
+  e = statBatch[i];
+  if(e == 0xFF) return;
+  if(i < NRF_txSent) {                              // frame acknowledged
+    stats[e].sent++;
+    stats[e].retries += NRF_txArc[i];
+    stats[e].rtt = rtt;
+    LINK_update(e, NRF_txArc[i]);
+  }
+  else if(i == NRF_txSent) {                        // frame hit MAX_RT
+    stats[e].fails++;
+    stats[e].retries += NRF_txArc[i];
+    LINK_lost(e);
+  }
+  if(i >= NRF_txSent) stats[e].waiting = 0;         // no reply to expect
+}
+
+#if TX_RESEND
+// Send the rest of a finished batch again, starting with the frame that hit
+// MAX_RT, if that one is a v2 frame: the slave may have applied it with only its
+// ACK lost, but ignores the repetition. Returns 1 if the batch went out again.
+uint8_t STAT_resend(uint16_t rtt) {
+  uint8_t i, j, k, e;
+  uint8_t sent = NRF_txSent;
+  if((sent >= statQueued) || (statRound >= TX_RESEND)) return 0;
+  if(!statLen[sent] || (statFrames[sent][P_START] != P_START_CHAR_V2)) return 0;
+  for(i=sent; i<statQueued; i++) if(!statLen[i]) return 0;
+  for(i=0; i<sent; i++) STAT_account(i, rtt);      // acknowledged ones are done
+  e = statBatch[sent];
+  if(e != 0xFF) stats[e].retries += NRF_txArc[sent];
+  for(i=sent, j=0; i<statQueued; i++, j++) {        // move the rest to the front
+    statBatch[j] = statBatch[i];
+    statReq[j]   = statReq[i];
+    statLen[j]   = statLen[i];
+    for(k=0; k<statLen[j]; k++) statFrames[j][k] = statFrames[i][k];
+    NRF_queuePayload(statFrames[j], statLen[j], statBatch[j] != 0xFF);
+  }
+  statReplies >>= sent;
+  statQueued = j;
+  statRound++;
+  statBusy = 0;
+  STAT_send();
+  return 1;
+}
+#endif
+
+// Account finished batch: per frame retransmits, success or MAX_RT failure
+void STAT_collect(void) {
+  uint8_t i;
+  uint16_t rtt;
+  if(!statBusy || (NRF_pollTX() == NRF_TX_BUSY)) return;
+  rtt = TICK_now() - statStart;
+  #if TX_RESEND
+  if(STAT_resend(rtt)) return;
+  statRound = 0;
+  #endif
+  for(i=0; i<statQueued; i++) STAT_account(i, rtt);
+  statQueued  = 0;
+  statReplies = 0;
+  statBusy    = 0;
+}
+
+// Wait for running batch (and its resends) and account it
+void STAT_finish(void) {
+  while(statBusy) {
+    while(NRF_pollTX() == NRF_TX_BUSY);
+    STAT_collect();
+  }
+}
+
+// Account valid reply frame from slave and cache its hello status or time; a slave
+// not yet in the table is registered, so it gets polled from now on
+void STAT_reply(__xdata uint8_t *frame) {
+  uint8_t e, hi;
+  uint16_t now;
+  e = STAT_entry(frame[P_FROM]);
+  if(e == 0xFF) return;
+  now = TICK_now();
+  if(stats[e].waiting) {
+    stats[e].latency = now - stats[e].asked;
+    stats[e].waiting = 0;
+  }
+  if(fleetBusy) fleetSeen |= (uint16_t)1 << P_SLOT(frame[P_FROM]);
+  stats[e].seen = now;
+  if(frame[P_CODE] == P_REPLY_HELLO) {
+    stats[e].status = ((uint16_t)frame[P_MSG_HIGH] << 8) | frame[P_MSG_LOW];
+    stats[e].cached |= POLL_STATUS;
+  }
+  else if(frame[P_CODE] == P_REPLY_TIME) {
+    stats[e].seconds = ((uint16_t)frame[P_MSG_LOW] << 8) | frame[P_MSG_HIGH];
+    stats[e].cached |= POLL_TIME;
+  }
+  else if(frame[P_CODE] == P_CODE_HELP) {           // help pushed by slave
+    hi = P_HELLO_HELP;
+    if((stats[e].cached & POLL_STATUS) && ((stats[e].status >> 8) == P_HELLO_END))
+      hi = P_HELLO_HELP_END;                        // keep known time-up state
+    stats[e].status = (uint16_t)hi << 8;
+    stats[e].cached |= POLL_STATUS;
+  }
+}
+
+// Account all reply frames in payload received via NRF; returns 1 if the payload
+// holds nothing but hello and time replies (an empty payload holds none of them)
+uint8_t STAT_replies(__xdata uint8_t *ptr, uint8_t len) {
+  uint8_t flen;
+  uint8_t polled = 1;
+  if(!len) return 0;                                // nothing to cache, forward it
+  for(; len; len -= flen, ptr += flen) {
+    flen = P_FRAME_LENGTH(ptr[P_START]);
+    if(len < flen) return 0;
+    if((P_check(ptr, flen) != P_OK) || (ptr[P_TO] != MASTER_ID)) {
+      polled = 0;
+      continue;
+    }
+    STAT_reply(ptr);
+    if((ptr[P_CODE] != P_REPLY_HELLO) && (ptr[P_CODE] != P_REPLY_TIME)) polled = 0;
+  }
+  if(polled && fleetBusy) fleetReplies++;
+  return polled;
+}
+
+// Print statistics table via CDC
+void STAT_print(void) {
+  uint8_t i;
+  #if LINK_ADAPT
+  CDC_println("# ID SENT RETR FAIL RTT  LAT  LVL");
+  #else
+  CDC_println("# ID SENT RETR FAIL RTT  LAT");
+  #endif
+  for(i=0; i<STAT_SLAVES; i++) {
+    if(!stats[i].id) break;
+    CDC_print("# ");
+    CDC_printByte(stats[i].id);                     CDC_write(' ');
+    CDC_printWord(stats[i].sent);                   CDC_write(' ');
+    CDC_printWord(stats[i].retries);                CDC_write(' ');
+    CDC_printWord(stats[i].fails);                  CDC_write(' ');
+    CDC_printWord(stats[i].rtt);                    CDC_write(' ');
+    CDC_printWord(stats[i].latency);
+    #if LINK_ADAPT
+    CDC_write(' '); CDC_printByte(stats[i].level);
+    #endif
+    CDC_write('\n');
+  }
+  CDC_flush();
+}
+
+#if LINK_ADAPT
+// Carry out pending level changes, telling the slave about data rate changes
+void LINK_service(void) {
+  uint8_t i, level, target;
+  for(i=0; i<STAT_SLAVES; i++) {
+    if(!stats[i].id) break;
+    level  = stats[i].level;
+    target = stats[i].target;
+    if(level == target) continue;
+    if(LINK_SPEED[level] != LINK_SPEED[target]) {   // data rate change?
+      P_fill(masterFrame, stats[i].id, MASTER_ID, P_CODE_RATE, LINK_SPEED[target], 0);
+      STAT_finish();                                // TX must be idle
+      NRF_txSetup = LINK_setup(level);              // tell slave at old rate
+      NRF_queuePayload(masterFrame, PROTOCOL_LENGTH, 1);
+      NRF_sendQueued();
+      while(NRF_pollTX() == NRF_TX_BUSY);
+      if(NRF_txState != NRF_TX_OK) {                // slave didn't get it
+        LINK_lost(i);
+        continue;
+      }
+    }
+    stats[i].level = target;
+  }
+}
+#endif
+
+// ===================================================================================
+// NRF Transmission
+// ===================================================================================
+
+// Check if buffer holds only complete protocol frames (v1 or v2)
+uint8_t isFrameBuffer(uint8_t len) {
+  __xdata uint8_t *ptr = buffer;
+  uint8_t flen;
+  if(!len) return 0;
+  for(; len; len -= flen, ptr += flen) {
+    flen = P_FRAME_LENGTH(ptr[P_START]);
+    if(len < flen) return 0;
+    if((ptr[P_START] != P_START_CHAR) && (flen != PROTOCOL_LENGTH_V2)) return 0;
+    if(ptr[flen - 1] != P_END_CHAR) return 0;
+  }
+  return 1;
+}
+
+// Check if any slave listens at data rate speed
+uint8_t isSpeedUsed(uint8_t speed) {
+  #if LINK_ADAPT
+  uint8_t i;
+  for(i=0; i<STAT_SLAVES; i++) {
+    if(stats[i].id && (LINK_SPEED[stats[i].level] == speed)) return 1;
+  }
+  #endif
+  return(speed == NRF_speed);
+}
+
+// Send broadcast payload once at each data rate a slave is listening at; a beacon
+// gets a fresh timestamp right before each copy goes out
+void sendBroadcast(__xdata uint8_t *frame, uint8_t len) {
+  uint8_t speed;
+  for(speed=0; speed<3; speed++) {
+    if(!isSpeedUsed(speed)) continue;
+    STAT_finish();                                  // TX must be idle
+    if(speed == NRF_speed) NRF_txSetup = NRF_rxSetup;
+    else NRF_txSetup = NRF_SETUP[speed] | NRF_POWER[NRF_power];
+    if((len == PROTOCOL_LENGTH) && (frame[P_CODE] == P_CODE_BEACON)) fillBeacon(frame);
+    NRF_queuePayload(frame, len, 0);
+    NRF_sendQueued();
+  }
+}
+
+// Broadcast master time so that slaves can lock their wall clocks to it
+void sendBeacon(void) {
+  beaconLast = TICK_now();
+  fillBeacon(masterFrame);
+  sendBroadcast(masterFrame, PROTOCOL_LENGTH);
+}
+
+// Let all slaves start their countdown at the same master second, delay seconds
+// from now; the frame is repeated since broadcasts are not acknowledged
+void startAll(uint8_t delay) {
+  uint8_t i, second;
+  if(delay < 2) delay = 2;                          // give beacons time to settle
+  if(delay > 60) delay = 60;                        // slaves know seconds mod 64
+  sendBeacon();                                     // slaves may not be locked yet
+  TICK_ATOMIC_BLOCK second = TICK_seconds;
+  second = (second + delay) & 0x3F;
+  P_fill(masterFrame, BROADCAST_ID, MASTER_ID, P_CODE_START_AT, second, 0);
+  for(i=START_REPEAT; i; i--) sendBroadcast(masterFrame, PROTOCOL_LENGTH);
+  CDC_print("# Start at second: "); CDC_printByte(second); CDC_write('\n');
+  CDC_flush();
+}
+
+// Add payload for slave dest to the TX batch, sending the batch first if it is
+// full or meant for another rate/power; payloads to all slaves go without ACK.
+// Returns 0 if the payload was broadcast on its own instead.
+uint8_t queueFor(__xdata uint8_t *ptr, uint8_t len, uint8_t dest) {
+  #if LINK_ADAPT
+  uint8_t level;
+  if(dest == BROADCAST_ID) {                        // broadcast?
+    STAT_send();                                    // -> on its own at every rate
+    sendBroadcast(ptr, len);
+    return 0;
+  }
+  level = LINK_level(dest);
+  if(statQueued && (level != statLevel)) {          // other rate/power than batch?
+    STAT_send();                                    // -> send batch first
+    STAT_finish();
+  }
+  statLevel = level;
+  #endif
+  while(!NRF_queuePayload(ptr, len, dest != BROADCAST_ID)) {
+    STAT_send();                                    // TX FIFO full -> send batch
+    STAT_finish();
+  }
+  STAT_queue(dest, ptr, len);
+  return 1;
+}
+
+// Get number of bytes of the frames at ptr that fit into one payload: up to
+// AGGREGATE frames, either all addressed to all slaves or all to slaves listening
+// at the same link level
+uint8_t packFrames(__xdata uint8_t *ptr, uint8_t len) {
+  uint8_t n, flen, frames;
+  uint8_t dest  = ptr[P_TO];
+  uint8_t level = LINK_level(dest);
+  n = P_FRAME_LENGTH(ptr[P_START]);
+  for(frames=1; (frames < AGGREGATE) && (n < len); frames++) {
+    flen = P_FRAME_LENGTH(ptr[n + P_START]);
+    if(n + flen > NRF_PAYLOAD) break;
+    if((ptr[n + P_TO] == BROADCAST_ID) != (dest == BROADCAST_ID)) break;
+    if(LINK_level(ptr[n + P_TO]) != level) break;
+    n += flen;
+  }
+  return n;
+}
+
+// Send buffer via NRF; protocol frames are packed into as few payloads as possible
+// and batched into the TX FIFO, frames addressed to all slaves are sent without ACK
+void sendBuffer(uint8_t len) {
+  __xdata uint8_t *ptr = buffer;
+  uint8_t flen;
+  STAT_finish();                                    // account previous batch
+  if(!isFrameBuffer(len)) {                         // raw data?
+    NRF_txSetup = NRF_rxSetup;                      // -> at configured rate
+    NRF_sendPayload(buffer, len);                   // -> send as one payload
+    return;
+  }
+  while(len) {
+    flen = packFrames(ptr, len);
+    queueFor(ptr, flen, ptr[P_TO]);
+    ptr += flen;
+    len -= flen;
+  }
+  STAT_send();                                      // send rest of batch
+}
+
+// ===================================================================================
+// Poll Scheduler
+// ===================================================================================
+// Every slave in the statistics table is polled in turn, one slave every pollPeriod
+// ms, with a hello and a time frame in one payload. The replies are cached in the
+// table, so the host gets the state of all slaves with a single "!snap" (or
+// BIN_SNAPSHOT) instead of polling each one over USB. Slaves enter the table when
+// the host addresses them, with "!addXX", or when they send a reply frame. Cached
+// values older than POLL_STALE ms are dropped.
+
+// Poll next slave in table if the radio is free
+void POLL_service(void) {
+  uint8_t i, e;
+  if(!pollPeriod || statQueued || statBusy || fleetBusy) return;
+  if((uint16_t)(TICK_now() - pollLast) < pollPeriod) return;
+  pollLast = TICK_now();
+  for(i=STAT_SLAVES; i; i--) {                      // find next used entry
+    e = pollNext;
+    if(++pollNext >= STAT_SLAVES) pollNext = 0;
+    if(!stats[e].id) continue;
+    if(stats[e].cached && ((uint16_t)(pollLast - stats[e].seen) >= POLL_STALE))
+      stats[e].cached = 0;                          // slave silent for too long
+    P_fill(masterFrame, stats[e].id, MASTER_ID, P_CODE_HELLO, 0, 0);
+    P_fill(masterFrame + PROTOCOL_LENGTH, stats[e].id, MASTER_ID, P_CODE_TIME, 0, 0);
+    queueFor(masterFrame, 2*PROTOCOL_LENGTH, stats[e].id);
+    STAT_send();
+    return;
+  }
+}
+
+// Age of cached values of table entry in 100ms, 0xFF if nothing cached
+uint8_t POLL_age(uint8_t e) {
+  uint16_t age;
+  if(!stats[e].cached) return 0xFF;
+  age = (uint16_t)(TICK_now() - stats[e].seen) / 100;
+  return (age > 0xFE) ? 0xFE : age;
+}
+
+// Print cached slave states via CDC
+void POLL_print(void) {
+  uint8_t i;
+  CDC_println("# ID STAT TIME AGE");
+  for(i=0; i<STAT_SLAVES; i++) {
+    if(!stats[i].id) break;
+    CDC_print("# ");
+    CDC_printByte(stats[i].id);                     CDC_write(' ');
+    CDC_printWord(stats[i].status);                 CDC_write(' ');
+    CDC_printWord(stats[i].seconds);                CDC_write(' ');
+    CDC_printByte(POLL_age(i));
+    CDC_write('\n');
+  }
+  CDC_flush();
+}
+
+// Send cached slave states as one binary packet: per slave ID, status (2 bytes),
+// seconds (2 bytes), age in 100ms (0xFF: nothing cached)
+void POLL_snapshot(uint8_t req) {
+  uint8_t i, n;
+  for(n=0; (n < STAT_SLAVES) && stats[n].id; n++);
+  BIN_begin(BIN_SLAVES, req, BIN_OK, n * 6);
+  for(i=0; i<n; i++) {
+    BIN_write(stats[i].id);
+    BIN_write(stats[i].status >> 8);
+    BIN_write(stats[i].status);
+    BIN_write(stats[i].seconds >> 8);
+    BIN_write(stats[i].seconds);
+    BIN_write(POLL_age(i));
+  }
+  BIN_end();
+}
+
+// ===================================================================================
+// Fleet Collection
+// ===================================================================================
+// A hello addressed to all slaves is answered by every slave in its own reply slot
+// (see protocol.h), with hello status and time in one payload. The master keeps
+// listening for FLEET_WINDOW ms, caching the replies like those of its own polls,
+// and then reports the slots nobody answered in. Polls and beacons pause meanwhile.
+
+// Broadcast hello and start collecting replies
+void FLEET_start(uint8_t bin, uint8_t req) {
+  STAT_finish();                                    // TX must be idle
+  fleetSeen    = 0;
+  fleetReplies = 0;
+  fleetReq     = req;
+  fleetBin     = bin;
+  P_fill(masterFrame, BROADCAST_ID, MASTER_ID, P_CODE_HELLO, 0, 0);
+  sendBroadcast(masterFrame, PROTOCOL_LENGTH);
+  while(NRF_pollTX() == NRF_TX_BUSY);               // slots count from reception
+  fleetStart = TICK_now();
+  fleetBusy  = 1;
+}
+
+// Report fleet collection once the last slot is over
+void FLEET_service(void) {
+  uint8_t i;
+  if(!fleetBusy || ((uint16_t)(TICK_now() - fleetStart) < FLEET_WINDOW)) return;
+  fleetBusy = 0;
+  if(fleetBin) {
+    binBuf[BIN_HEADER]     = fleetSeen >> 8;
+    binBuf[BIN_HEADER + 1] = fleetSeen;
+    BIN_packet(BIN_FLEET_DONE, fleetReq, BIN_OK, binBuf + BIN_HEADER, 2);
+    return;
+  }
+  CDC_print("# Fleet replies: "); CDC_printByte(fleetReplies); CDC_write('\n');
+  CDC_print("# Silent slots:");
+  for(i=0; i<P_SLOTS; i++) {
+    if(fleetSeen & ((uint16_t)1 << i)) continue;
+    CDC_write(' '); CDC_printByte(i);
+  }
+  CDC_write('\n');
+  POLL_print();
+}
+
+// ===================================================================================
+// Host Notifications
+// ===================================================================================
+
+// Derive line state from radio events and hand changes to EP1
+#if HOST_NOTIFY
+void NOTE_service(void) {
+  uint8_t i, hi;
+  uint8_t state = 0;
+  uint16_t now = TICK_now();
+  if(NRF_available() || (CDC_txHead != CDC_txTail) || CDC_writeBusyFlag)
+    state |= NOTE_RX;                               // data on its way to host
+  for(i=0; i<STAT_SLAVES; i++) {
+    if(!stats[i].id) break;
+    if(!(stats[i].cached & POLL_STATUS)) continue;
+    if((uint16_t)(now - stats[i].seen) >= POLL_STALE) continue;
+    hi = stats[i].status >> 8;
+    if((hi == P_HELLO_HELP) || (hi == P_HELLO_HELP_END)) state |= NOTE_HELP;
+    if((hi == P_HELLO_END)  || (hi == P_HELLO_HELP_END)) state |= NOTE_TIME;
+  }
+  CDC_notify(state);
+}
+#endif
+
+// ===================================================================================
+// Binary Host Protocol - Input
+// ===================================================================================
+// Packets are SLIP framed (RFC 1055) in both directions and start with a 4-byte
+// header: type, request ID, destination (to master) or status (from master) and
+// payload length. Any number of packets may share one USB transfer. BIN_SEND
+// payloads are batched like text frames and each is answered with a BIN_STATUS
+// carrying the same request ID once its fate is known, so requests can be
+// pipelined; payloads received via NRF are forwarded as BIN_RECEIVE.
+
+// Handle decoded packet from host
+void BIN_handle(void) {
+  uint8_t len = binBuf[3];
+  if(binBuf[0] == BIN_EXIT) {                       // back to text mode?
+    STAT_send();
+    binMode = 0;
+    return;
+  }
+  if(binBuf[0] == BIN_SNAPSHOT) {                   // cached slave states?
+    POLL_snapshot(binBuf[1]);
+    return;
+  }
+  if(binBuf[0] == BIN_FLEET) {                      // collect fleet status?
+    FLEET_start(1, binBuf[1]);
+    return;
+  }
+  if(binBuf[0] != BIN_SEND) {
+    BIN_status(binBuf[1], BIN_BAD_TYPE, 0);
+    return;
+  }
+  if((binLen != BIN_HEADER + len) || !len) {        // length doesn't match?
+    BIN_status(binBuf[1], BIN_BAD_LENGTH, 0);
+    return;
+  }
+  if(!queueFor(binBuf + BIN_HEADER, len, binBuf[2])) {
+    BIN_status(binBuf[1], BIN_OK, 0);               // broadcast already gone
+    return;
+  }
+  statReq[statQueued - 1] = binBuf[1];              // reply when batch is done
+  statReplies |= 1 << (statQueued - 1);
+}
+
+// Feed byte from host into SLIP decoder
+void BIN_receive(uint8_t value) {
+  if(value == BIN_END) {                            // end of packet?
+    if(binLen && (binLen != 0xFF)) {
+      if(binLen < BIN_HEADER) BIN_status(binBuf[1], BIN_BAD_LENGTH, 0);
+      else BIN_handle();
+    }
+    binLen = 0;
+    binEsc = 0;
+    return;
+  }
+  if(binEsc) {                                      // escaped byte?
+    binEsc = 0;
+    if(value == BIN_ESC_END) value = BIN_END;
+    else if(value == BIN_ESC_ESC) value = BIN_ESC;
+  }
+  else if(value == BIN_ESC) {
+    binEsc = 1;
+    return;
+  }
+  if(binLen >= sizeof(binBuf)) binLen = 0xFF;       // too long -> drop packet
+  if(binLen == 0xFF) return;
+  binBuf[binLen++] = value;
+}
+
+// ===================================================================================
+// Channel Scan
+// ===================================================================================
+
+// Check if buffer holds the given command word after CMD_IDENT
+uint8_t isCommand(__code char *cmd) {
+  __xdata uint8_t *ptr = buffer + 1;
+  while(*cmd) if(*ptr++ != *cmd++) return 0;
+  return 1;
+}
+
+// Sweep all channels and print carrier hits per channel via CDC
+void scanChannels(void) {
+  uint8_t ch, hits;
+  uint8_t best = 0, bestHits = 0xFF;
+  CDC_print("# Channel scan, carrier hits per "); CDC_printByte(SCAN_SAMPLES);
+  CDC_println(" samples:");
+  for(ch=0; ch<NRF_CHANNELS; ch++) {
+    if(!(ch & 0x1F)) {                              // start new row of 32 channels
+      if(ch) CDC_write('\n');
+      CDC_printByte(ch); CDC_print(": ");
+    }
+    hits = NRF_carrier(ch, SCAN_SAMPLES);           // sample received power detector
+    CDC_printByte(hits);
+    if(hits < bestHits) {                           // quietest channel so far?
+      bestHits = hits;
+      best = ch;
+    }
+    WDT_reset();                                    // a full scan takes about 1.5s
+  }
+  CDC_write('\n');
+  CDC_print("# Quietest channel: "); CDC_printByte(best); CDC_write('\n');
+  CDC_flush();
+  NRF_configure();                                  // back to working channel
+}
+
 // ===================================================================================
 // Command Parser
 // ===================================================================================
-void parse(void) {
+// Parse command in buffer, len is the number of bytes received
+void parse(uint8_t len) {
   uint8_t cmd = buffer[1];                          // read the command
+  if(isCommand("scan")) {                           // channel scan?
+    scanChannels();                                 // -> settings stay untouched
+    return;
+  }
+  if(isCommand("stat")) {                           // slave statistics?
+    STAT_print();                                   // -> settings stay untouched
+    return;
+  }
+  if(isCommand("fleet")) {                          // collect fleet status?
+    FLEET_start(0, 0);                              // -> settings stay untouched
+    return;
+  }
+  if(isCommand("snap")) {                           // cached slave states?
+    POLL_print();                                   // -> settings stay untouched
+    return;
+  }
+  if(isCommand("poll")) {                           // poll period in 10ms
+    pollPeriod = hexByte(buffer + 5) * 10;          // -> settings stay untouched
+    CDC_print("# Poll period ms: "); CDC_printWord(pollPeriod); CDC_write('\n');
+    CDC_flush();
+    return;
+  }
+  if(isCommand("beac")) {                           // beacon period in 100ms
+    beaconPeriod = hexByte(buffer + 5) * 100;       // -> settings stay untouched
+    CDC_print("# Beacon period ms: "); CDC_printWord(beaconPeriod); CDC_write('\n');
+    CDC_flush();
+    return;
+  }
+  if(isCommand("usb")) {                            // USB upload mode?
+    if((len > 4) && (buffer[4] >= '0'))             // argument given?
+      CDC_setCoalesce(hexByte(buffer + 4) != 0);
+    CDC_printUSB();                                 // -> settings stay untouched
+    CDC_flush();
+    return;
+  }
+  if(isCommand("bench")) {                          // USB throughput benchmark?
+    CDC_bench();                                    // -> settings stay untouched
+    return;
+  }
+  if(isCommand("add")) {                            // register slave for polling
+    if(STAT_entry(hexByte(buffer + 4)) == 0xFF) CDC_println("# Slave table full");
+    else STAT_print();
+    CDC_flush();
+    return;
+  }
+  if(isCommand("bin")) {                            // binary host protocol?
+    CDC_println("# Binary mode");
+    CDC_flush();
+    binLen  = 0;
+    binMode = 1;                                    // -> until BIN_EXIT
+    return;
+  }
+  if(cmd == 'a') {                                  // start all slaves at once?
+    startAll(hexByte(buffer + 2));                  // -> settings stay untouched
+    return;
+  }
   switch(cmd) {                                     // what command?
     case 'i': NRF_id = hexByte(buffer + 2) & 0xFF;
               break;
@@ -213,6 +1246,9 @@ void parse(void) {
     default:  break;
   }
   NRF_configure();                                  // reconfigure the NRF
+  #if LINK_ADAPT
+  LINK_reset();                                     // start over at new settings
+  #endif
   CDC_printSettings();                              // print settings via CDC
   FLASH_writeSettings();                            // update settings in data flash
 }
@@ -224,6 +1260,7 @@ void main(void) {
   // Variables
   uint8_t buflen;                                   // data length in buffer
   uint8_t bufptr;                                   // buffer pointer
+  __xdata uint8_t *rxptr;                           // payload in NRF RX ring
 
   // Setup
   CLK_config();                                     // configure system clock
@@ -231,33 +1268,51 @@ void main(void) {
   FLASH_readSettings();                             // read user settings from flash
   CDC_init();                                       // init USB CDC
   NRF_init();                                       // init nRF24L01+
+  TICK_init();                                      // start millisecond tick
+  #if LINK_ADAPT
+  LINK_reset();                                     // links at configured settings
+  #endif
   WDT_start();                                      // start watchdog timer
 
   // Loop
   while(1) {
     if(NRF_available()) {                           // something coming in via NRF?
       PIN_low(PIN_LED);                             // switch on LED
-      bufptr = 0;                                   // reset buffer pointer
-      buflen = NRF_readPayload(buffer);             // read payload into buffer
-      while(buflen--) CDC_write(buffer[bufptr++]);  // write buffer via USB CDC
-      CDC_flush();                                  // flush CDC
-      
+      rxptr = NRF_peekPayload(&buflen);             // payload stays in RX ring
+      if(STAT_replies(rxptr, buflen) && (pollPeriod || fleetBusy)) {} // cached only
+      else if(binMode) BIN_packet(BIN_RECEIVE, 0, BIN_OK, rxptr, buflen);
+      else {
+        CDC_writeBlock(rxptr, buflen);              // ring slot -> USB CDC FIFO
+        CDC_flush();                                // flush CDC
+      }
+      NRF_releasePayload();                         // hand slot back to interrupt
     }
 
-    buflen = CDC_available();                       // get number of bytes in CDC IN
-    if(buflen) {                                    // something coming in via USB?
-      bufptr = 0;                                   // reset buffer pointer
-      if(buflen > NRF_PAYLOAD) buflen = NRF_PAYLOAD;// restrict length to max payload
-      while(buflen--) buffer[bufptr++] = CDC_read();// get data from CDC
-      if(buffer[0] == CMD_IDENT) parse();           // is it a command? -> parse
+    if(binMode) {                                   // binary host protocol?
+      while(CDC_available()) BIN_receive(CDC_read());
+      STAT_send();                                  // send what was batched
+    }
+    else if(CDC_available()) {                      // something coming in via USB?
+      bufptr = CDC_readBlock(buffer, NRF_PAYLOAD);  // get data from CDC
+      if(buffer[0] == CMD_IDENT) parse(bufptr);     // is it a command? -> parse
       if(buffer[0] == HELP_IDENT) printHelp();      // prints help
       if(buffer[0] == ID_IDENT) printID();          // prints master id
       else {                                        // not a command?
         PIN_low(PIN_LED);                           // switch on LED
-        NRF_writePayload(buffer, bufptr);           // send the buffer via NRF
+        sendBuffer(bufptr);                         // send the buffer via NRF
       }
     }
   
+    NRF_pollTX();                                   // service pending transmission
+    STAT_collect();                                 // account finished batch
+    LINK_service();                                 // switch links if needed
+    POLL_service();                                 // poll next slave if it's time
+    FLEET_service();                                // report fleet when slots are over
+    #if HOST_NOTIFY
+    NOTE_service();                                 // signal radio events via EP1
+    #endif
+    if(beaconPeriod && !fleetBusy && ((uint16_t)(TICK_now() - beaconLast) >= beaconPeriod))
+      sendBeacon();                                 // time for next beacon
     PIN_high(PIN_LED);                              // switch off LED
     WDT_reset();                                    // reset watchdog
   }
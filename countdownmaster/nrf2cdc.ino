@@ -12,6 +12,9 @@
 //   - Clock Source:  16 MHz (internal)
 //   - Upload Method: USB
 //   - USB Settings:  USER CODE /w 266B USB RAM
+//   The ping-pong buffered CDC endpoints need 278 bytes of USB RAM, which is more
+//   than the largest ch55xduino setting, so the Arduino build stops with an error
+//   (see src/usb_descr.h). Compile with the makefile instead.
 // - Press BOOT button on the board and keep it pressed while connecting it via USB
 //   with your PC.
 // - Click on "Upload" immediatly afterwards.
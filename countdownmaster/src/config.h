@@ -16,10 +16,33 @@
 // USB2NRF Settings
 #define NRF_PAYLOAD         32        // NRF max payload (1-32)
 #define NRF_CONFIG          0x0C      // CRC scheme, 0x08:8bit, 0x0C:16bit
+#define NRF_IRQ_RX          1         // 1: receive via INT1 on PIN_IRQ, 0: poll NRF
+#define NRF_RX_SLOTS        4         // RX ring buffer size in payloads (power of 2)
+#define NRF_ACK_PAYLOAD     0         // 1: poll replies in auto-ACK, single slave only:
+                                      // all slaves share one RX address, so several
+                                      // would ACK a poll and their payloads collide
+#define NRF_RX_STAMP        0         // 1: timestamp received payloads (tick.c)
+#define CDC_TX_FIFO         128       // USB TX FIFO in bytes (power of 2, 64 - 128)
+#define CDC_TX_POLICY       CDC_DROP_NEWEST // full USB TX FIFO: CDC_DROP_NEWEST/OLDEST
+#define CDC_COALESCE        0         // 1: start in USB throughput mode (!usb01)
+#define BENCH_KB            60        // KiB uploaded by !bench (1 - 63)
 #define FLASH_IDENT         0xA96C    // to identify if data flash was written
 #define CMD_IDENT           '!'       // command string identifier
 #define HELP_IDENT          '?'       // help command
 #define ID_IDENT            'i'       // id command
+#define SCAN_SAMPLES        64        // RPD samples per channel for !scan
+#define STAT_SLAVES         8         // slaves tracked by !stat
+#define LINK_ADAPT          1         // 1: adapt data rate/power per slave
+#define LINK_WINDOW         16        // acknowledged frames per adaption step
+#define LINK_UP_RETRIES     1         // max retransmits in window to step up
+#define LINK_DOWN_RETRIES   16        // min retransmits in window to step down
+#define BEACON_PERIOD       0         // ms between time beacons (0: off until !beacXX)
+#define START_REPEAT        3         // copies of a start-at broadcast
+#define TX_RESEND           2         // resends of a v2 frame lost after MAX_RT
+#define AGGREGATE           4         // max protocol frames packed into one payload
+#define POLL_PERIOD         0         // ms between slave polls (0: off until !poll)
+#define POLL_STALE          20000     // ms without reply until cached values expire
+#define HOST_NOTIFY         1         // 1: signal radio events via SERIAL_STATE on EP1
 
 // USB device descriptor
 #define USB_VENDOR_ID       0x16C0    // VID (shared www.voti.nl)
@@ -33,4 +56,5 @@
 #define MANUFACTURER_STR    'D','I','G','I','T','I','Z','E'
 #define PRODUCT_STR         'U','S','B','2','N','R','F'
 #define SERIAL_STR          'C','H','5','5','x','C','D','C'
+#define SERIAL_CHIP_ID      1         // 1: serial number from chip ID, 0: SERIAL_STR
 #define INTERFACE_STR       'C','D','C','-','S','e','r','i','a','l'
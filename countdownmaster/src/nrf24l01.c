@@ -6,6 +6,10 @@
 
 #include "nrf24l01.h"
 #include "spi.h"
+#include "delay.h"
+#if NRF_RX_STAMP
+#include "tick.h"
+#endif
 
 // ===================================================================================
 // nRF24L01+ Implementation - Definitions and Variables
@@ -13,9 +17,12 @@
 
 // NRF registers
 #define NRF_REG_CONFIG        0x00              // configuration register
+#define NRF_REG_SETUP_RETR    0x04              // setup of automatic retransmission
 #define NRF_REG_RF_CH         0x05              // RF frequency channel
 #define NRF_REG_RF_SETUP      0x06              // RF setup register
 #define NRF_REG_STATUS        0x07              // status register
+#define NRF_REG_OBSERVE_TX    0x08              // transmit observe register
+#define NRF_REG_RPD           0x09              // received power detector
 #define NRF_REG_RX_ADDR_P0    0x0A              // RX address pipe 0
 #define NRF_REG_RX_ADDR_P1    0x0B              // RX address pipe 1
 #define NRF_REG_TX_ADDR       0x10              // TX address
@@ -27,8 +34,25 @@
 #define NRF_CMD_R_RX_PL_WID   0x60              // read RX payload length
 #define NRF_CMD_R_RX_PAYLOAD  0x61              // read RX payload
 #define NRF_CMD_W_TX_PAYLOAD  0xA0              // write TX payload
+#define NRF_CMD_W_TX_NOACK    0xB0              // write TX payload, no ACK requested
+#define NRF_CMD_W_ACK_PAYLOAD 0xA8              // write ACK payload (+ pipe number)
 #define NRF_CMD_FLUSH_TX      0xE1              // flush TX FIFO
 #define NRF_CMD_FLUSH_RX      0xE2              // flush RX FIFO
+#define NRF_CMD_NOP           0xFF              // no operation, just clock out STATUS
+
+// NRF STATUS bits (clocked out with the first byte of every command)
+#define NRF_STATUS_RX_DR      0x40              // payload received
+#define NRF_STATUS_TX_DS      0x20              // payload sent
+#define NRF_STATUS_MAX_RT     0x10              // maximum retransmits reached
+#define NRF_STATUS_RX_P_NO    0x0E              // pipe of next RX payload, 0x0E: RX FIFO empty
+
+
+// NRF FEATURE register value
+#if NRF_ACK_PAYLOAD
+#define NRF_FEATURE           0x07              // dyn payload length, ACK payload, NOACK
+#else
+#define NRF_FEATURE           0x05              // dyn payload length, NOACK
+#endif
 
 // NRF global variables
 __xdata uint8_t NRF_id        = 0xFF;           // master id
@@ -37,32 +61,80 @@ __xdata uint8_t NRF_speed     = 0;              // 0:250kbps, 1:1Mbps, 2:2Mbps
 __xdata uint8_t NRF_power     = 3;              // 0:-18dBm, 1:-12dBm, 2:-6dBm, 3:0dBm
 __xdata uint8_t NRF_tx_addr[] = {0xE7, 0xE7, 0xE7, 0xE7, 0xE7};
 __xdata uint8_t NRF_rx_addr[] = {0xC2, 0xC2, 0xC2, 0xC2, 0xC2};
-__code uint8_t  NRF_SETUP[]   = {0x26, 0x06, 0x0E};
-__code uint8_t  NRF_POWER[]   = {0x00, 0x01, 0x02, 0x03};
+__code uint8_t  NRF_SETUP[]   = {0x20, 0x00, 0x08}; // RF_DR_LOW/RF_DR_HIGH, RF_PWR clear
+__code uint8_t  NRF_POWER[]   = {0x00, 0x02, 0x04, 0x06}; // RF_PWR in bits 2:1
+__xdata uint8_t NRF_rxSetup;                    // RF_SETUP while listening
+__xdata uint8_t NRF_txSetup;                    // RF_SETUP for next transmission
+__xdata uint8_t NRF_rfSetup;                    // RF_SETUP currently in NRF
 __code uint8_t* NRF_STR[]     = {"250k", "1M", "2M"};
 __code uint8_t* NRF_STR_PW[]  = {"-18","-12","-6","0"};
 
+// NRF RX ring buffer (filled by the INT1 interrupt, emptied by NRF_readPayload
+// or NRF_releasePayload)
+#if NRF_IRQ_RX
+__xdata uint8_t NRF_rxRing[NRF_RX_SLOTS][NRF_PAYLOAD];
+__xdata uint8_t NRF_rxLen[NRF_RX_SLOTS];
+volatile __xdata uint8_t NRF_rxHead = 0;        // slots written by interrupt
+volatile __xdata uint8_t NRF_rxTail = 0;        // slots read by main loop
+volatile __bit NRF_rxStalled = 0;               // ring was full, payloads left in FIFO
+#if NRF_RX_STAMP
+__xdata uint16_t NRF_rxStamps[NRF_RX_SLOTS];    // TICK_ms at reception
+#endif
+#else
+__xdata uint8_t NRF_rxSlot[NRF_PAYLOAD];        // payload handed out by NRF_peekPayload
+#endif
+#if NRF_RX_STAMP
+__xdata uint16_t NRF_rxStamp;                   // TICK_ms at reception of last read payload
+#endif
+
+// NRF transmission state (completed by INT1 interrupt or NRF_pollTX)
+volatile __xdata uint8_t NRF_txState   = NRF_TX_IDLE; // NRF_TX_* state of last payload
+volatile __xdata uint8_t NRF_txRetries = 0;     // retransmits of last batch (ARC_CNT)
+volatile __xdata uint8_t NRF_txArc[3];          // retransmits per payload of last batch
+volatile __xdata uint8_t NRF_txSent = 0;        // payloads of last batch sent
+__xdata uint8_t NRF_txQueued = 0;               // payloads queued for next batch
+__xdata uint8_t NRF_txPending = 0;              // payloads of batch not yet reported sent
+volatile uint8_t NRF_status;                    // STATUS of last SPI command
+volatile __xdata uint16_t NRF_spiCount = 0;     // CSN-framed SPI transactions
+volatile __bit NRF_ackSent = 0;                 // preloaded ACK payload went out
+
 // ===================================================================================
 // nRF24L01+ Implementation - SPI Communication Functions
 // ===================================================================================
+// These are shared between main loop and RX interrupt, the main loop keeps INT1
+// off the bus with NRF_ATOMIC_BLOCK. Each one stores the STATUS byte the NRF clocks
+// out with the command in NRF_status, so callers don't need an extra transaction.
+#pragma save
+#pragma nooverlay
 
 // NRF setup
 void NRF_init(void) {
   SPI_init();
   NRF_configure();
+  #if NRF_IRQ_RX
+  PIN_input_PU(PIN_IRQ);                                // IRQ pin is active low
+  IT1 = 1;                                              // INT1 on falling edge
+  IE1 = 0;                                              // clear pending INT1
+  EX1 = 1;                                              // enable INT1
+  #endif
+}
+
+// NRF start SPI transaction with command byte, capture STATUS
+void NRF_select(uint8_t cmd) {
+  PIN_low(PIN_CSN);
+  NRF_status = SPI_transfer(cmd);
+  NRF_spiCount++;
 }
 
 // NRF send a command
 void NRF_writeCommand(uint8_t cmd) {
-  PIN_low(PIN_CSN);
-  SPI_transfer(cmd);
+  NRF_select(cmd);
   PIN_high(PIN_CSN);
 }
 
 // NRF write one byte into the specified register
 void NRF_writeRegister(uint8_t reg, uint8_t value) {
-  PIN_low(PIN_CSN);
-  SPI_transfer(reg + 0x20);
+  NRF_select(reg + 0x20);
   SPI_transfer(value);
   PIN_high(PIN_CSN);
 }
@@ -70,8 +142,7 @@ void NRF_writeRegister(uint8_t reg, uint8_t value) {
 // NRF read one byte from the specified register
 uint8_t NRF_readRegister(uint8_t reg) {
   uint8_t value;
-  PIN_low(PIN_CSN);
-  SPI_transfer(reg);
+  NRF_select(reg);
   value = SPI_transfer(0);
   PIN_high(PIN_CSN);
   return value;
@@ -80,20 +151,25 @@ uint8_t NRF_readRegister(uint8_t reg) {
 // NRF write an array of bytes into the specified registers
 void NRF_writeBuffer(uint8_t reg, __xdata uint8_t *buf, uint8_t len) {
   if(reg < 0x20) reg += 0x20;
-  PIN_low(PIN_CSN);
-  SPI_transfer(reg);
-  while(len--) SPI_transfer(*buf++);
+  NRF_select(reg);
+  SPI_writeBlock(buf, len);
   PIN_high(PIN_CSN);
 }
 
 // NRF read an array of bytes from the specified registers
 void NRF_readBuffer(uint8_t reg, __xdata uint8_t *buf, uint8_t len) {
-  PIN_low(PIN_CSN);
-  SPI_transfer(reg);
-  while(len--) *buf++ = SPI_transfer(0);
+  NRF_select(reg);
+  SPI_readBlock(buf, len);
   PIN_high(PIN_CSN);
 }
 
+// NRF get STATUS with a single byte transaction
+uint8_t NRF_readStatus(void) {
+  NRF_writeCommand(NRF_CMD_NOP);
+  return NRF_status;
+}
+#pragma restore
+
 // ===================================================================================
 // nRF24L01+ Implementation - Transceiver Functions
 // ===================================================================================
@@ -107,6 +183,10 @@ void NRF_powerDown(void) {
 // NRF switch to RX mode
 void NRF_powerRX(void) {
   PIN_low(PIN_CE);                                      // return to Standby-I
+  if(NRF_rfSetup != NRF_rxSetup) {                      // listen at other rate/power?
+    NRF_rfSetup = NRF_rxSetup;
+    NRF_writeRegister(NRF_REG_RF_SETUP, NRF_rfSetup);
+  }
   NRF_writeRegister(NRF_REG_CONFIG, NRF_CONFIG | 0x03); // PWR_UP + PRIM_RX
   PIN_high(PIN_CE);                                     // switch to RX Mode
 }
@@ -114,44 +194,276 @@ void NRF_powerRX(void) {
 // NRF switch to TX mode
 void NRF_powerTX(void) {
   PIN_low(PIN_CE);                                      // return to Standby-I
+  if(NRF_rfSetup != NRF_txSetup) {                      // send at other rate/power?
+    NRF_rfSetup = NRF_txSetup;
+    NRF_writeRegister(NRF_REG_RF_SETUP, NRF_rfSetup);
+  }
   NRF_writeRegister(NRF_REG_CONFIG, NRF_CONFIG | 0x02); // PWR_UP + !PRIM_RX
   PIN_high(PIN_CE);                                     // switch to TX Mode
 }
 
 // NRF configure
 void NRF_configure(void) {
-  PIN_low(PIN_CE);                                      // leave active mode
-  NRF_writeBuffer(NRF_REG_RX_ADDR_P1, NRF_rx_addr, 5);  // set RX address
-  NRF_writeBuffer(NRF_REG_TX_ADDR,    NRF_tx_addr, 5);  // set TX address
-  NRF_writeBuffer(NRF_REG_RX_ADDR_P0, NRF_tx_addr, 5);  // set TX address for auto-ACK
-  NRF_writeRegister(NRF_REG_RF_CH, NRF_channel);        // set channel
-  NRF_writeRegister(NRF_REG_RF_SETUP, NRF_SETUP[NRF_speed]); // set speed and power
-  NRF_writeRegister(NRF_REG_FEATURE,  0x04);            // enable dynamic payload length
-  NRF_writeRegister(NRF_REG_DYNPD,    0x3F);            // enable dynamic payload length
-  NRF_writeCommand(NRF_CMD_FLUSH_RX);                   // flush RX FIFO
-  NRF_powerRX();                                        // switch to RX Mode
+  while(NRF_pollTX() == NRF_TX_BUSY);                   // let transmission finish
+  NRF_ATOMIC_BLOCK {
+    PIN_low(PIN_CE);                                    // leave active mode
+    NRF_writeBuffer(NRF_REG_RX_ADDR_P1, NRF_rx_addr, 5);  // set RX address
+    NRF_writeBuffer(NRF_REG_TX_ADDR,    NRF_tx_addr, 5);  // set TX address
+    NRF_writeBuffer(NRF_REG_RX_ADDR_P0, NRF_tx_addr, 5);  // set TX address for auto-ACK
+    NRF_writeRegister(NRF_REG_RF_CH, NRF_channel);      // set channel
+    NRF_rfSetup = NRF_SETUP[NRF_speed] | NRF_POWER[NRF_power];
+    NRF_rxSetup = NRF_rfSetup;                          // default for RX and TX
+    NRF_txSetup = NRF_rfSetup;
+    NRF_writeRegister(NRF_REG_RF_SETUP, NRF_rfSetup);   // set speed and power
+    #if NRF_ACK_PAYLOAD
+    NRF_writeRegister(NRF_REG_SETUP_RETR, 0x33);        // 1000us retransmit delay for ACK payload
+    #endif
+    NRF_writeRegister(NRF_REG_FEATURE,  NRF_FEATURE);   // enable features
+    NRF_writeRegister(NRF_REG_DYNPD,    0x3F);          // enable dynamic payload length
+    NRF_writeCommand(NRF_CMD_FLUSH_RX);                 // flush RX FIFO
+    NRF_writeRegister(NRF_REG_STATUS, 0x70);            // clear flags, release IRQ pin
+    NRF_txPending = 0;
+    NRF_powerRX();                                      // switch to RX Mode
+  }
+}
+
+// Finish transmitted payload, return to listening when TX FIFO is empty
+// (clears only the TX flags seen in status, so no later event gets lost)
+#pragma save
+#pragma nooverlay
+void NRF_finishTX(uint8_t status) {
+  uint8_t arc;
+  status &= (NRF_STATUS_TX_DS | NRF_STATUS_MAX_RT);
+  if(NRF_txState != NRF_TX_BUSY) {                      // not transmitting?
+    if(status & NRF_STATUS_TX_DS) NRF_ackSent = 1;      // -> ACK payload sent in RX mode
+    NRF_writeRegister(NRF_REG_STATUS, status);          // clear flag
+    return;
+  }
+  arc = NRF_readRegister(NRF_REG_OBSERVE_TX) & 0x0F;    // get ARC_CNT
+  NRF_txRetries += arc;
+  if(NRF_txSent < 3) NRF_txArc[NRF_txSent] = arc;       // of current payload
+  if(status & NRF_STATUS_MAX_RT) {                      // MAX_RT reached?
+    NRF_writeCommand(NRF_CMD_FLUSH_TX);                 // -> drop remaining payloads
+    NRF_txState = NRF_TX_FAIL;
+  }
+  NRF_writeRegister(NRF_REG_STATUS, status);            // clear TX flags
+  if(NRF_txState == NRF_TX_BUSY) {                      // payload sent
+    NRF_txSent++;
+    if(NRF_txPending) NRF_txPending--;
+    if(NRF_txPending) {                                 // more queued? TX_DS may have merged,
+      if(!(NRF_readRegister(NRF_REG_FIFO_STATUS) & 0x10)) return; // -> keep sending
+      for(; NRF_txPending; NRF_txPending--) {           // TX FIFO empty -> merged ones sent too
+        if(NRF_txSent < 3) NRF_txArc[NRF_txSent] = 0;   // ARC_CNT was overwritten
+        NRF_txSent++;
+      }
+    }
+    NRF_txState = NRF_TX_OK;
+  }
+  NRF_txPending = 0;
+  NRF_powerRX();                                        // return to listening
+}
+
+#if NRF_IRQ_RX
+// INT1 service routine: finish transmission, move RX FIFO into ring buffer;
+// R_RX_PL_WID doubles as RX FIFO check via RX_P_NO in the STATUS byte.
+// INT1 is edge triggered, so loop until no flag is left: an event raised
+// while the IRQ pin is still low produces no new falling edge.
+void NRF_interrupt(void) {
+  uint8_t status, slot, len;
+  status = NRF_readStatus();                            // what happened?
+  do {
+    if(status & (NRF_STATUS_TX_DS | NRF_STATUS_MAX_RT)) NRF_finishTX(status);
+    if(status & NRF_STATUS_RX_DR)
+      NRF_writeRegister(NRF_REG_STATUS, NRF_STATUS_RX_DR); // clear RX_DR
+    NRF_rxStalled = 0;
+    while(1) {
+      len = NRF_readRegister(NRF_CMD_R_RX_PL_WID);      // read payload length
+      if((NRF_status & NRF_STATUS_RX_P_NO) == NRF_STATUS_RX_P_NO) break; // RX FIFO empty
+      if((uint8_t)(NRF_rxHead - NRF_rxTail) >= NRF_RX_SLOTS) {
+        NRF_rxStalled = 1;                              // ring full, keep rest in FIFO
+        break;
+      }
+      if(len > NRF_PAYLOAD) {                           // corrupted length?
+        NRF_writeCommand(NRF_CMD_FLUSH_RX);             // -> discard FIFO
+        break;
+      }
+      slot = NRF_rxHead & (NRF_RX_SLOTS - 1);
+      NRF_readBuffer(NRF_CMD_R_RX_PAYLOAD, NRF_rxRing[slot], len); // read payload
+      NRF_rxLen[slot] = len;
+      #if NRF_RX_STAMP
+      NRF_rxStamps[slot] = TICK_ms;                     // tick can't preempt here
+      #endif
+      NRF_rxHead++;
+    }
+    status = NRF_readStatus();                          // new flags meanwhile?
+  } while(status & (NRF_STATUS_RX_DR | NRF_STATUS_TX_DS | NRF_STATUS_MAX_RT));
 }
+#endif
+#pragma restore
 
+#if NRF_IRQ_RX
 // Check if data is available for reading
 uint8_t NRF_available(void) {
-  if(NRF_readRegister(NRF_REG_STATUS) & 0x40) return 1;
-  return(!(NRF_readRegister(NRF_REG_FIFO_STATUS) & 0x01));
+  return(NRF_rxHead != NRF_rxTail);
+}
+
+// Read payload bytes into buffer, return payload length
+uint8_t NRF_readPayload(__xdata uint8_t *buf) {
+  uint8_t slot, len, i;
+  __xdata uint8_t *src;
+  if(NRF_rxHead == NRF_rxTail) return 0;                // nothing received
+  slot = NRF_rxTail & (NRF_RX_SLOTS - 1);
+  len  = NRF_rxLen[slot];                               // get payload length
+  src  = NRF_rxRing[slot];
+  #if NRF_RX_STAMP
+  NRF_rxStamp = NRF_rxStamps[slot];
+  #endif
+  for(i=len; i; i--) *buf++ = *src++;                   // copy payload
+  NRF_releasePayload();                                 // release slot
+  return len;                                           // return payload length
+}
+
+// Get next payload in place without copying it, return pointer and length; the
+// slot stays owned by the main loop until NRF_releasePayload()
+__xdata uint8_t* NRF_peekPayload(uint8_t *len) {
+  uint8_t slot = NRF_rxTail & (NRF_RX_SLOTS - 1);
+  if(NRF_rxHead == NRF_rxTail) {                        // nothing received
+    *len = 0;
+    return 0;
+  }
+  *len = NRF_rxLen[slot];                               // get payload length
+  #if NRF_RX_STAMP
+  NRF_rxStamp = NRF_rxStamps[slot];
+  #endif
+  return NRF_rxRing[slot];
+}
+
+// Hand the slot of the peeked payload back to the interrupt
+void NRF_releasePayload(void) {
+  NRF_rxTail++;                                         // release slot
+  #if NRF_RX_STAMP
+  if(NRF_rxStalled) NRF_ATOMIC_BLOCK TICK_ATOMIC_BLOCK NRF_interrupt(); // refill, keep stamps whole
+  #else
+  if(NRF_rxStalled) NRF_ATOMIC_BLOCK NRF_interrupt();   // refill from RX FIFO
+  #endif
+}
+#else
+// Check if data is available for reading
+uint8_t NRF_available(void) {
+  return((NRF_readStatus() & NRF_STATUS_RX_P_NO) != NRF_STATUS_RX_P_NO);
 }
 
 // Read payload bytes into buffer, return payload length
 uint8_t NRF_readPayload(__xdata uint8_t *buf) {
   uint8_t len = NRF_readRegister(NRF_CMD_R_RX_PL_WID);  // read payload length
+  #if NRF_RX_STAMP
+  NRF_rxStamp = TICK_now();
+  #endif
   NRF_readBuffer(NRF_CMD_R_RX_PAYLOAD, buf, len);       // read payload
-  NRF_writeRegister(NRF_REG_STATUS, 0x40);              // reset status register
+  if(NRF_status & NRF_STATUS_RX_DR)                     // only if not yet done
+    NRF_writeRegister(NRF_REG_STATUS, NRF_STATUS_RX_DR);  // reset status register
   return len;                                           // return payload length
 }
 
-// Send a data package (max length 32)
+// Without the ring there is nothing to point into, read payload into one slot
+__xdata uint8_t* NRF_peekPayload(uint8_t *len) {
+  *len = NRF_readPayload(NRF_rxSlot);
+  return NRF_rxSlot;
+}
+
+void NRF_releasePayload(void) {
+}
+#endif
+
+// Queue a data package (max length 32) for the next batch, return 0 if TX FIFO full
+// (a package without ACK request is sent once and never retransmitted)
+uint8_t NRF_queuePayload(__xdata uint8_t *buf, uint8_t len, uint8_t ack) {
+  if(NRF_txQueued >= 3) return 0;                       // TX FIFO is 3 levels deep
+  while(NRF_pollTX() == NRF_TX_BUSY);                   // previous batch still on air
+  NRF_ATOMIC_BLOCK {
+    if(!NRF_txQueued) {                                 // first payload of batch?
+      PIN_low(PIN_CE);                                  // return to Standby-I
+      NRF_writeCommand(NRF_CMD_FLUSH_TX);               // flush TX FIFO
+      if(NRF_status & (NRF_STATUS_TX_DS | NRF_STATUS_MAX_RT)) // stale TX flags?
+        NRF_finishTX(NRF_status);                       // -> clear them
+    }
+    NRF_writeBuffer(ack ? NRF_CMD_W_TX_PAYLOAD : NRF_CMD_W_TX_NOACK, buf, len);
+  }
+  NRF_txQueued++;
+  return 1;
+}
+
+// Start transmitting all queued data packages
+void NRF_sendQueued(void) {
+  if(!NRF_txQueued) return;                             // nothing queued
+  NRF_ATOMIC_BLOCK {
+    NRF_txPending = NRF_txQueued;
+    NRF_txQueued  = 0;
+    NRF_txRetries = 0;
+    NRF_txSent    = 0;
+    NRF_txState   = NRF_TX_BUSY;
+    NRF_powerTX();                                      // switch to TX Mode and transmit
+  }
+}
+
+// Start sending a data package (max length 32), wait only for a previous one
+void NRF_sendPayload(__xdata uint8_t *buf, uint8_t len) {
+  NRF_sendQueued();                                     // don't mix with open batch
+  NRF_queuePayload(buf, len, 1);                        // write payload
+  NRF_sendQueued();                                     // and transmit
+}
+
+// Preload ACK payload (max length 32) for the next package received on RX pipe 1
+void NRF_writeAckPayload(__xdata uint8_t *buf, uint8_t len) {
+  while(NRF_pollTX() == NRF_TX_BUSY);                   // TX FIFO in use
+  NRF_ATOMIC_BLOCK {
+    NRF_writeCommand(NRF_CMD_FLUSH_TX);                 // drop stale ACK payload
+    NRF_writeBuffer(NRF_CMD_W_ACK_PAYLOAD | 1, buf, len);
+    NRF_ackSent = 0;
+  }
+}
+
+// Change RF_SETUP used while listening (e.g. data rate agreed with the master)
+void NRF_setRxSetup(uint8_t setup) {
+  while(NRF_pollTX() == NRF_TX_BUSY);                   // let transmission finish
+  NRF_ATOMIC_BLOCK {
+    NRF_rxSetup = setup;
+    NRF_powerRX();                                      // listen with new setup
+  }
+}
+
+// Count how often the received power detector (> -64dBm) fires on channel within
+// samples listening windows; the caller restores the channel with NRF_configure()
+uint8_t NRF_carrier(uint8_t channel, uint8_t samples) {
+  uint8_t hits = 0;
+  while(NRF_pollTX() == NRF_TX_BUSY);                   // let transmission finish
+  NRF_ATOMIC_BLOCK {
+    PIN_low(PIN_CE);                                    // return to Standby-I
+    NRF_writeRegister(NRF_REG_RF_CH, channel);          // tune to channel
+    while(samples--) {
+      PIN_high(PIN_CE);                                 // listen
+      DLY_us(NRF_RPD_DELAY);                            // PLL settling + RPD averaging
+      PIN_low(PIN_CE);                                  // latch RPD
+      hits += NRF_readRegister(NRF_REG_RPD) & 0x01;     // carrier detected?
+    }
+  }
+  return hits;
+}
+
+// Service transmission, return NRF_TX_* state of last payload
+uint8_t NRF_pollTX(void) {
+  #if !NRF_IRQ_RX
+  uint8_t status;
+  if((NRF_txState == NRF_TX_BUSY) || NRF_ACK_PAYLOAD) {
+    status = NRF_readStatus();
+    if(status & (NRF_STATUS_TX_DS | NRF_STATUS_MAX_RT)) NRF_finishTX(status); // finished?
+  }
+  #endif
+  return NRF_txState;
+}
+
+// Send a data package (max length 32) and wait until finished
 void NRF_writePayload(__xdata uint8_t *buf, uint8_t len) {
-  NRF_writeRegister(NRF_REG_STATUS, 0x30);              // clear status flags
-  NRF_writeCommand(NRF_CMD_FLUSH_TX);                   // flush TX FIFO
-  NRF_powerTX();                                        // switch to TX Mode
-  NRF_writeBuffer(NRF_CMD_W_TX_PAYLOAD, buf, len);      // write payload and transmit
-  while(!(NRF_readRegister(NRF_REG_STATUS) & 0x30));    // wait until finished
-  NRF_powerRX();                                        // return to listening
+  NRF_sendPayload(buf, len);                            // start transmission
+  while(NRF_pollTX() == NRF_TX_BUSY);                   // wait until finished
 }
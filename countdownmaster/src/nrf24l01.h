@@ -16,12 +16,58 @@ extern __xdata uint8_t NRF_speed;               // 0:250kbps, 1:1Mbps, 2:2Mbps
 extern __xdata uint8_t NRF_power;               // 0:-18dBm, 1:-12dBm, 2:-6dBm, 3:0dBm
 extern __xdata uint8_t NRF_tx_addr[];           // transmit address
 extern __xdata uint8_t NRF_rx_addr[];           // receive address
+extern __xdata uint8_t NRF_rxSetup;             // RF_SETUP while listening
+extern __xdata uint8_t NRF_txSetup;             // RF_SETUP for next transmission
+extern __code uint8_t NRF_SETUP[];              // RF_SETUP speed bits per NRF_speed
+extern __code uint8_t NRF_POWER[];              // RF_SETUP power bits per NRF_power
 extern __code uint8_t* NRF_STR[];               // speed strings
 extern __code uint8_t* NRF_STR_PW[];            // power strings
 
+// NRF channel scan
+#define NRF_CHANNELS    126                     // channels 0x00 - 0x7D (2400 - 2525MHz)
+#define NRF_RPD_DELAY   170                     // us in RX until RPD is valid (130 + 40)
+
+// NRF transmission state
+#define NRF_TX_IDLE     0                       // nothing sent yet
+#define NRF_TX_BUSY     1                       // payload on air, auto-retransmit running
+#define NRF_TX_OK       2                       // all payloads sent (and acknowledged)
+#define NRF_TX_FAIL     3                       // MAX_RT reached, rest of batch dropped
+extern volatile __xdata uint8_t NRF_txState;    // NRF_TX_* state of last payload
+extern volatile __xdata uint8_t NRF_txRetries;  // retransmits of last batch
+extern volatile __xdata uint8_t NRF_txArc[3];   // retransmits per payload of last batch
+extern volatile __xdata uint8_t NRF_txSent;     // payloads of last batch sent (on FAIL: failed one)
+extern volatile __bit NRF_ackSent;              // preloaded ACK payload went out
+
+// NRF receive timestamp (TICK_ms when the payload arrived)
+#if NRF_RX_STAMP
+extern __xdata uint16_t NRF_rxStamp;            // of the payload read last
+#endif
+
+// NRF SPI bookkeeping
+extern volatile uint8_t NRF_status;             // STATUS clocked out by last command
+extern volatile __xdata uint16_t NRF_spiCount;  // SPI transactions, clear before a call to count it
+
 // NRF functions
 void NRF_init(void);                            // init NRF
 void NRF_configure(void);                       // configure NRF
 uint8_t NRF_available(void);                    // check if data is available for reading
 uint8_t NRF_readPayload(__xdata uint8_t *buf); // read payload into buffer, return length
+__xdata uint8_t* NRF_peekPayload(uint8_t *len); // get next payload in place and its length
+void NRF_releasePayload(void);                  // done with payload from NRF_peekPayload
+void NRF_sendPayload(__xdata uint8_t *buf, uint8_t len);   // start sending a package, don't wait
+uint8_t NRF_queuePayload(__xdata uint8_t *buf, uint8_t len, uint8_t ack); // queue package for batch (max 3)
+void NRF_sendQueued(void);                      // start transmitting queued packages
+void NRF_writeAckPayload(__xdata uint8_t *buf, uint8_t len); // preload ACK payload for RX pipe 1
+uint8_t NRF_pollTX(void);                       // service transmission, return NRF_TX_* state
+void NRF_setRxSetup(uint8_t setup);            // change RF_SETUP used while listening
+uint8_t NRF_carrier(uint8_t channel, uint8_t samples); // count RPD hits on channel
 void NRF_writePayload(__xdata uint8_t *buf, uint8_t len);  // send a data package (max length 32)
+
+// NRF interrupt (INT1, PIN_IRQ must be P33)
+#if NRF_IRQ_RX
+void NRF_interrupt(void);                       // finish TX, drain RX FIFO into ring buffer
+// keep RX interrupt off the SPI bus, EX1 is left as found (nested use, NRF_init)
+#define NRF_ATOMIC_BLOCK  for(uint8_t _ex1 = EX1 | 2; _ex1 && !(EX1 = 0); EX1 = _ex1 & 1, _ex1 = 0)
+#else
+#define NRF_ATOMIC_BLOCK
+#endif
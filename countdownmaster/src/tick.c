@@ -0,0 +1,77 @@
+// ===================================================================================
+// Millisecond Tick Functions for CH551, CH552 and CH554                      * v1.0 *
+// ===================================================================================
+
+#include "tick.h"
+
+#define TICK_RELOAD   (65536 - (F_CPU / 1000))    // Timer2 counts per millisecond
+
+volatile uint16_t TICK_ms = 0;
+volatile __xdata uint16_t TICK_phase   = 0;
+volatile __xdata uint16_t TICK_seconds = 0;
+volatile __xdata int16_t  TICK_slew    = 0;     // ms the wall clock is behind (< 0: ahead)
+volatile __bit TICK_halfSecond = 0;
+
+// Start 1ms tick on Timer2
+void TICK_init(void) {
+  T2MOD  |= bTMR_CLK | bT2_CLK;             // Timer2 clock = Fsys
+  T2CON   = 0;                              // 16-bit auto-reload timer, stopped
+  RCAP2   = TICK_RELOAD;                    // reload value
+  T2COUNT = TICK_RELOAD;
+  TF2     = 0;                              // clear overflow flag
+  ET2     = 1;                              // enable Timer2 interrupt
+  TR2     = 1;                              // start Timer2
+}
+
+// Timer2 interrupt handler (call from INT_NO_TMR2 service routine)
+#pragma save
+#pragma nooverlay
+void TICK_interrupt(void) {
+  uint8_t steps = 1;
+  TF2 = 0;                                  // clear overflow flag
+  TICK_ms++;
+  if(TICK_slew > 0) {                       // behind master?
+    steps++;                                // -> run at double speed
+    TICK_slew--;
+  }
+  else if(TICK_slew < 0) {                  // ahead of master?
+    steps--;                                // -> stand still
+    TICK_slew++;
+  }
+  while(steps--) {
+    if(++TICK_phase >= 1000) {
+      TICK_phase = 0;
+      TICK_seconds++;
+    }
+    if((TICK_phase == 0) || (TICK_phase == 500)) TICK_halfSecond = 1;
+  }
+}
+#pragma restore
+
+// Read millisecond counter (16-bit read must not be split by the interrupt)
+uint16_t TICK_now(void) {
+  uint16_t now;
+  TICK_ATOMIC_BLOCK now = TICK_ms;
+  return now;
+}
+
+// Lock wall clock to master time (seconds mod 64, ms within second)
+void TICK_sync(uint8_t seconds, uint16_t phase) {
+  int16_t error;
+  int8_t  delta;
+  TICK_ATOMIC_BLOCK {
+    delta = (seconds - TICK_seconds) & 0x3F;      // whole seconds apart (mod 64)
+    if(delta >= 32) delta -= 64;
+    error = (int16_t)(phase - TICK_phase);
+    if(delta == 1) error += 1000;
+    else if(delta == -1) error -= 1000;
+    else if(delta) error = TICK_SLEW_MAX + 1;     // more than a second apart
+    if((error >= -TICK_SLEW_MAX) && (error <= TICK_SLEW_MAX)) {
+      TICK_slew = error;                          // slew out small error
+    } else {                                      // far off -> set clock
+      TICK_seconds += delta;                      // nearest second matching mod 64
+      TICK_phase   = phase;
+      TICK_slew    = 0;
+    }
+  }
+}
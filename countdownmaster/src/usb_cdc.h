@@ -6,9 +6,12 @@
 // --------------------
 // CDC_init()               init USB-CDC
 // CDC_available()          get number of bytes in the IN buffer
-// CDC_ready()              check if OUT buffer is ready to be written
+// CDC_ready()              check if OUT buffer has room for a full packet
+// CDC_free()               get number of free bytes in OUT buffer
 // CDC_read()               read single character from IN buffer
-// CDC_write(c)             write single character to OUT buffer
+// CDC_readBlock(b,n)       read up to n bytes into b, returns bytes read
+// CDC_write(c)             write single character to OUT buffer (1: ok, 0: dropped)
+// CDC_writeBlock(b,n)      write n bytes of buffer b, returns bytes accepted
 // CDC_writeflush(c)        write single character to OUT buffer and flush
 // CDC_print(s)             write string to OUT buffer
 // CDC_println(s)           write string with newline to OUT buffer and flush
@@ -16,6 +19,20 @@
 // CDC_getDTR()             get DTR flag
 // CDC_getRTS()             get RTS flag
 // CDC_getBAUD()            get BAUD rate
+// CDC_notify(s)            send SERIAL_STATE bitmap s via EP1 if it changed
+// CDC_setCoalesce(x)       1: throughput mode, 0: flush per packet
+//
+// Writing never blocks: bytes go to a software FIFO of CDC_TX_FIFO bytes which is
+// drained packet by packet into the two IN banks of EP2, one is filled while the
+// other one is sent. Reading works the same way on the two OUT banks. When the host doesn't read, the FIFO
+// fills up and CDC_TX_POLICY decides whether the newest or the oldest bytes are
+// dropped. CDC_txDropped counts lost bytes, CDC_txPeak holds the highest fill level.
+//
+// CDC_flush() uploads right away by default. In throughput mode (CDC_COALESCE or
+// CDC_setCoalesce(1)) only full packets do, everything else written during a 1ms
+// USB frame goes out in one packet at the next start of frame. CDC_txFlushes,
+// CDC_txPackets and CDC_txBytes count flush calls, uploaded packets and their
+// bytes (fill ratio = bytes / packets / 64); read them in CDC_ATOMIC_BLOCK.
 //
 // 2022 by Stefan Wagner:   https://github.com/wagiminator
 
@@ -25,25 +42,52 @@
 #include "usb_descr.h"
 #include "usb_handler.h"
 
+// Transmit FIFO defaults, set them in config.h
+#ifndef CDC_TX_FIFO
+  #define CDC_TX_FIFO     64      // OUT buffer size (power of 2, 64 - 128)
+#endif
+#define CDC_DROP_NEWEST   0       // full FIFO: discard bytes being written
+#define CDC_DROP_OLDEST   1       // full FIFO: discard bytes not yet uploaded
+#ifndef CDC_TX_POLICY
+  #define CDC_TX_POLICY   CDC_DROP_NEWEST
+#endif
+#ifndef CDC_COALESCE
+  #define CDC_COALESCE    0       // 1: start in throughput mode
+#endif
+
 // ===================================================================================
 // CDC Variables
 // ===================================================================================
 extern volatile __xdata uint8_t CDC_readByteCount;// number of data bytes in IN buffer
 extern volatile __bit CDC_writeBusyFlag;     // flag of whether upload pointer is busy
+extern volatile __xdata uint8_t CDC_txHead;  // bytes written to OUT FIFO
+extern volatile __xdata uint8_t CDC_txTail;  // bytes uploaded from OUT FIFO
+extern volatile __xdata uint16_t CDC_txDropped; // bytes lost to FIFO overflow
+extern volatile __xdata uint8_t CDC_txPeak;  // highest FIFO fill level seen
+extern volatile __xdata uint16_t CDC_txFlushes; // CDC_flush() calls
+extern volatile __xdata uint16_t CDC_txPackets; // IN packets uploaded
+extern volatile __xdata uint16_t CDC_txBytes;   // bytes in these packets
+extern volatile __bit CDC_coalesce;          // 1: throughput mode (SOF-timed)
 
 // ===================================================================================
 // CDC Functions
 // ===================================================================================
 void CDC_flush(void);             // flush OUT buffer
 char CDC_read(void);              // read single character from IN buffer
-void CDC_write(char c);           // write single character to OUT buffer
+uint8_t CDC_readBlock(__xdata uint8_t *buf, uint8_t max); // read block, returns length
+uint8_t CDC_write(char c);        // write single character to OUT buffer
+uint8_t CDC_writeBlock(__xdata uint8_t *buf, uint8_t len); // write block, returns bytes accepted
 void CDC_print(char* str);        // write string to OUT buffer
 void CDC_println(char* str);      // write string with newline to OUT buffer and flush
+void CDC_notify(uint8_t state);   // send SERIAL_STATE notification if state changed
 
 #define CDC_init                  USB_init                      // setup USB-CDC
 #define CDC_available()           (CDC_readByteCount)           // ready to be read
-#define CDC_ready()               (!CDC_writeBusyFlag)          // ready to be written
+#define CDC_free()                ((uint8_t)(CDC_TX_FIFO - (uint8_t)(CDC_txHead - CDC_txTail)))
+#define CDC_ready()               (CDC_free() >= EP2_SIZE)      // room for a packet
 #define CDC_writeflush(c)         {CDC_write(c);CDC_flush();}   // write & flush char
+#define CDC_setCoalesce(x)        (CDC_coalesce = (x))          // select upload mode
+#define CDC_ATOMIC_BLOCK          for(IE_USB=0;!IE_USB;IE_USB=1) // keep USB interrupt out
 
 // ===================================================================================
 // CDC Control Line State
@@ -54,6 +98,17 @@ extern volatile __xdata uint8_t CDC_controlLineState;           // control line
 #define CDC_getDTR()    (CDC_DTR_flag)                          // get DTR flag
 #define CDC_getRTS()    (CDC_RTS_flag)                          // get RTS flag
 
+// ===================================================================================
+// CDC Serial State (UART state bitmap of the SERIAL_STATE notification)
+// ===================================================================================
+#define CDC_STATE_DCD   0x01      // bRxCarrier
+#define CDC_STATE_DSR   0x02      // bTxCarrier
+#define CDC_STATE_BREAK 0x04      // bBreak
+#define CDC_STATE_RI    0x08      // bRingSignal
+#define CDC_STATE_FRAME 0x10      // bFraming
+#define CDC_STATE_PAR   0x20      // bParity
+#define CDC_STATE_OVR   0x40      // bOverRun
+
 // ===================================================================================
 // CDC Line Coding
 // ===================================================================================
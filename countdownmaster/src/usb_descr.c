@@ -135,8 +135,23 @@ __code uint16_t ProdDescr[] = {
   ((uint16_t)USB_DESCR_TYP_STRING << 8) | sizeof(ProdDescr), PRODUCT_STR };
 
 // Serial String Descriptor (Index 3)
+#if SERIAL_CHIP_ID
+__xdata uint16_t SerDescr[1 + SERIAL_DIGITS];
+
+// Build serial string from chip ID as hex digits, most significant first
+void USB_initSerial(void) {
+  uint8_t i, digit;
+  SerDescr[0] = ((uint16_t)USB_DESCR_TYP_STRING << 8) | sizeof(SerDescr);
+  for(i=0; i<SERIAL_DIGITS; i++) {
+    digit = *(__code uint8_t*)(ROM_CHIP_ID + SERIAL_DIGITS/2 - 1 - (i >> 1));
+    digit = (i & 1) ? (digit & 0x0F) : (digit >> 4);
+    SerDescr[1 + i] = digit + ((digit > 9) ? ('A' - 10) : '0');
+  }
+}
+#else
 __code uint16_t SerDescr[] = {
   ((uint16_t)USB_DESCR_TYP_STRING << 8) | sizeof(SerDescr), SERIAL_STR };
+#endif
 
 // Interface String Descriptor (Index 4)
 __code uint16_t InterfDescr[] = {
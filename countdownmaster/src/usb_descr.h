@@ -12,8 +12,10 @@
 // All string descriptors.
 //
 // In the makefile the following microcontroller settings must be made:
-// XRAM_LOC   = 0x0100
-// XRAM_SIZE  = 0x0300
+// XRAM_LOC   = 0x0116      (EP0 10 + EP1 12 + EP2 256 bytes of USB RAM)
+// XRAM_SIZE  = 0x02EA
+// The makefile passes XRAM_LOC to the compiler as well, so that the endpoint
+// buffers are checked against it (ch55xduino: against USER_USB_RAM).
 
 #pragma once
 #include <stdint.h>
@@ -24,18 +26,25 @@
 // USB Endpoint Definitions
 // ===================================================================================
 #define EP0_SIZE        8
-#define EP1_SIZE        8
+#define EP1_SIZE        10        // holds a complete SERIAL_STATE notification
 #define EP2_SIZE        64
 
 #define EP0_BUF_SIZE    EP_BUF_SIZE(EP0_SIZE)
 #define EP1_BUF_SIZE    EP_BUF_SIZE(EP1_SIZE)
-#define EP2_BUF_SIZE    EP_BUF_SIZE(EP2_SIZE) + 64
+#define EP2_BUF_SIZE    (4 * EP2_SIZE)  // 2 OUT + 2 IN ping-pong banks
 #define EP_BUF_SIZE(x)  (x+2<64 ? x+2 : 64)
 
 #define EP0_ADDR        0
 #define EP1_ADDR        (EP0_ADDR + EP0_BUF_SIZE)
 #define EP2_ADDR        (EP1_ADDR + EP1_BUF_SIZE)
 
+#if defined(XRAM_LOC) && (EP2_ADDR + EP2_BUF_SIZE > XRAM_LOC)
+#error "USB endpoint buffers overlap user XRAM, raise XRAM_LOC in the makefile"
+#endif
+#if defined(USER_USB_RAM) && (EP2_ADDR + EP2_BUF_SIZE > USER_USB_RAM)
+#error "USB endpoint buffers don't fit into USER_USB_RAM, use the makefile"
+#endif
+
 __xdata __at (EP0_ADDR) uint8_t EP0_buffer[EP0_BUF_SIZE];     
 __xdata __at (EP1_ADDR) uint8_t EP1_buffer[EP1_BUF_SIZE];
 __xdata __at (EP2_ADDR) uint8_t EP2_buffer[EP2_BUF_SIZE];
@@ -64,12 +73,26 @@ extern __code USB_CFG_DESCR_CDC CfgDescr;
 extern __code uint16_t LangDescr[];
 extern __code uint16_t ManufDescr[];
 extern __code uint16_t ProdDescr[];
-extern __code uint16_t SerDescr[];
 extern __code uint16_t InterfDescr[];
 
 #define USB_STR_DESCR_i0    (uint8_t*)LangDescr
 #define USB_STR_DESCR_i1    (uint8_t*)ManufDescr
 #define USB_STR_DESCR_i2    (uint8_t*)ProdDescr
-#define USB_STR_DESCR_i3    (uint8_t*)SerDescr
 #define USB_STR_DESCR_i4    (uint8_t*)InterfDescr
+
+// The serial number string is either fixed (SERIAL_STR) or built from the unique
+// chip ID at start in XRAM, so that every device enumerates with its own serial
+#if SERIAL_CHIP_ID
+#define ROM_CHIP_ID         0x3FFC    // unique chip ID (32 bits) in code flash
+#define SERIAL_DIGITS       8         // hex digits of chip ID
+extern __xdata uint16_t SerDescr[1 + SERIAL_DIGITS];
+void USB_initSerial(void);            // build serial string from chip ID
+
+#define USB_STR_DESCR_i3    (uint8_t*)SerDescr
+#define USB_STR_DESCR_XRAM  3         // index of string descriptor in XRAM
+#define USB_STR_DESCR_ix    (uint8_t*)InterfDescr
+#else
+extern __code uint16_t SerDescr[];
+#define USB_STR_DESCR_i3    (uint8_t*)SerDescr
 #define USB_STR_DESCR_ix    (uint8_t*)SerDescr
+#endif
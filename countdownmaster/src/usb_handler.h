@@ -22,8 +22,10 @@ extern __code uint8_t*   USB_pDescr;
 uint8_t CDC_control(void);
 void CDC_EP_init(void);
 void CDC_EP0_OUT(void);
+void CDC_EP1_IN(void);
 void CDC_EP2_IN(void);
 void CDC_EP2_OUT(void);
+void CDC_SOF(void);
 
 // ===================================================================================
 // USB Handler Defines
@@ -37,8 +39,10 @@ void CDC_EP2_OUT(void);
 #define EP0_SETUP_callback  USB_EP0_SETUP
 #define EP0_IN_callback     USB_EP0_IN
 #define EP0_OUT_callback    USB_EP0_OUT
+#define EP1_IN_callback     CDC_EP1_IN
 #define EP2_IN_callback     CDC_EP2_IN
 #define EP2_OUT_callback    CDC_EP2_OUT
+#define SOF_callback        CDC_SOF
 
 // ===================================================================================
 // Functions
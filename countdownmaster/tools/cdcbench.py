@@ -0,0 +1,59 @@
+#!/usr/bin/env python3
+# ===================================================================================
+# Project:   cdcbench - USB CDC Throughput Benchmark for the NRF2CDC Stick
+# Year:      2026
+# License:   MIT License
+# ===================================================================================
+#
+# Description:
+# ------------
+# Sends "!bench" to the stick, which uploads BENCH_KB KiB of text lines the way it
+# forwards received payloads, and reports the sustained throughput measured by the
+# host and by the stick. Flash the builds to compare one after another and run the
+# benchmark on the same host and port with the same USB mode (!usb00 / !usb01).
+#
+# Dependencies:
+# -------------
+# - pyserial
+#
+# Operating Instructions:
+# -----------------------
+# Install pySerial via "python3 -m pip install pyserial".
+# Run "python3 cdcbench.py /dev/ttyACM0 [runs]".
+
+import sys
+import time
+import serial
+
+def bench(port):
+    port.reset_input_buffer()
+    port.write(b'!bench\n')
+    data  = b''
+    first = None
+    while b'# USB bench' not in data:
+        chunk = port.read(4096)
+        if not chunk:
+            raise IOError('no answer from stick')
+        if first is None:
+            first = time.perf_counter()
+        data += chunk
+    while not data.endswith(b'\n'):
+        data += port.read(1)
+    last  = time.perf_counter()
+    text, report = data.rsplit(b'# USB bench', 1)
+    fields = report.decode().split()            # KiB: XX ms: XXXX left: XXXX dropped: XXXX
+    kib, ms = int(fields[1], 16), int(fields[3], 16)
+    left, dropped = int(fields[5], 16), int(fields[7], 16)
+    size = kib * 1024 - left
+    print('received %6d bytes, host %7.1f KiB/s, stick %7.1f KiB/s, dropped %d'
+          % (len(text) - 1, size / 1024 / (last - first),
+             size / 1.024 / ms if ms else 0, dropped))
+
+if __name__ == '__main__':
+    if len(sys.argv) < 2:
+        sys.exit('Usage: python3 cdcbench.py <port> [runs]')
+    runs = int(sys.argv[2]) if len(sys.argv) > 2 else 3
+    with serial.Serial(sys.argv[1], timeout=2) as port:
+        port.dtr = True
+        for i in range(runs):
+            bench(port)
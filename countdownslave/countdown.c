@@ -12,21 +12,10 @@
 #include "src/spi.h"
 #include "src/adc.h"
 #include "src/speaker.h"
+#include "src/protocol.h"                 // countdown protocol definitions
+#include "src/tick.h"                     // millisecond tick functions
+#include "src/log.h"                      // deferred trace log
 
-#define DEBUG_MODE        1
-
-#define MASTER_ID         0xFF        
-
-
-#define PROTOCOL_LENGTH   8
-#define P_START           0
-#define P_TO              1
-#define P_FROM            2
-#define P_CODE            3
-#define P_MSG_HIGH        4
-#define P_MSG_LOW         5
-#define P_CHECKSUM        6
-#define P_END             7
 
 // Prototypes for used interrupts
 void USB_interrupt(void);
@@ -34,15 +23,40 @@ void USB_ISR(void) __interrupt(INT_NO_USB) {
   USB_interrupt();
 }
 
+#if NRF_IRQ_RX
+void NRF_interrupt(void);
+void NRF_ISR(void) __interrupt(INT_NO_INT1) {
+  NRF_interrupt();
+}
+#endif
+
 // Global variables
 __xdata uint8_t buffer[NRF_PAYLOAD];      // rx/tx buffer
-__xdata uint8_t buffer_protocol[PROTOCOL_LENGTH];      // rx/tx buffer
+__xdata uint8_t buffer_protocol[2*PROTOCOL_LENGTH_V2]; // reply frame(s)
+__xdata uint8_t buffer_reply[NRF_PAYLOAD];             // replies to frames of one payload
+uint8_t replyLen = 0;                                  // bytes in buffer_reply
+__xdata uint16_t replyDue;                             // tick at which the reply slot comes
+__bit replyScheduled = 0;                              // replies wait for their slot
+__xdata uint8_t seqWin[SEQ_WINDOW];                    // SEQ of last v2 frames applied
+__xdata uint8_t seqReply[SEQ_WINDOW][PROTOCOL_LENGTH_V2]; // reply sent to each of them
+__xdata uint8_t seqReplyLen[SEQ_WINDOW];               // length of cached reply, 0: none
+uint8_t seqFill = 0;                                   // window entries used
+uint8_t seqNext = 0;                                   // entry to be replaced next
+#define SEQ_NONE          0xFF                         // frame has no entry (v1 or poll)
+uint8_t seqSlot = SEQ_NONE;                            // entry of frame being processed
+uint8_t frameLength = PROTOCOL_LENGTH;                 // length of frame being processed
+#if NRF_ACK_PAYLOAD
+__xdata uint8_t buffer_ack[2*PROTOCOL_LENGTH];         // hello + time reply for auto-ACK
+uint8_t ackReload = 1;
+#endif
 __code uint8_t passcode[4] = {1,4,4,2}; 
 
 uint8_t buttonPressed;
 uint8_t buttonLast = 0;
-uint8_t updateTimer = 0;
-uint8_t clockOn = 0;
+volatile uint8_t halfSeconds = 0;                      // half seconds not yet handled by loop
+volatile __bit secondHalf = 0;                         // in second half of current second
+volatile uint8_t startAt = 0;                          // 0x80 | second to start at, 0: none
+volatile uint8_t clockOn = 0;
 uint8_t clockEnd = 0;
 uint8_t dot = 1;
 uint8_t keyboardActive = 0;
@@ -52,6 +66,27 @@ uint8_t keyboardtimeout = 10;
 uint8_t askForHelp = 0;
 uint8_t configChanged = 0;
 uint8_t timeChanged = 0;
+uint8_t linkSpeed;                                     // data rate agreed with master
+uint8_t linkIdle = 0;                                  // half seconds without master frame
+
+// Timer2 interrupt: millisecond tick, counts down the running clock every full
+// second of the (master synchronized) wall clock, independent of how long the
+// main loop takes; a scheduled start happens right at its second
+void TICK_interrupt(void);
+void TICK_ISR(void) __interrupt(INT_NO_TMR2) {
+  TICK_interrupt();
+  if(!TICK_halfSecond) return;
+  TICK_halfSecond = 0;
+  halfSeconds++;
+  secondHalf = (TICK_phase >= 500);
+  if(secondHalf) return;
+  if(clockOn && display_timeseconds) display_timeseconds--;
+  if(startAt && ((TICK_seconds & 0x3F) == (startAt & 0x3F))) {
+    clockOn  = 1;
+    clockEnd = 0;
+    startAt  = 0;
+  }
+}
 
 
 // ===================================================================================
@@ -169,6 +204,7 @@ void parse(void) {
     default:  break;
   }
   NRF_configure();                                  // reconfigure the NRF
+  linkSpeed = NRF_speed;                            // listening at configured rate
   CDC_printSettings();                              // print settings via CDC
   FLASH_writeSettings();                            // update settings in data flash
 }
@@ -207,72 +243,114 @@ uint8_t checkPasscode(){
   return result;
 }
 
-void sendHelpMaster(){
-  buffer_protocol[0] = 0x0A;
-  buffer_protocol[1] = MASTER_ID;
-  buffer_protocol[2] = NRF_id;
-  buffer_protocol[3] = 0x07;
-  buffer_protocol[4] = 0;
-  buffer_protocol[5] = 0;
-  buffer_protocol[6] = buffer_protocol[1] + buffer_protocol[2] + buffer_protocol[3] + buffer_protocol[4]+ buffer_protocol[5];
-  buffer_protocol[7] = 0x0D;
+// Fill a reply frame addressed to the master; a v2 frame is answered in v2 with
+// its SEQ
+void fillReply(__xdata uint8_t *frame, uint8_t code, uint8_t high, uint8_t low){
+  P_fill(frame, MASTER_ID, NRF_id, code, high, low);
+  if(frameLength == PROTOCOL_LENGTH_V2){
+    P_setSeq(frame, buffer[P_SEQ]);
+  }
+}
+
+// Send replies collected while processing a payload as one payload
+void sendReplies(){
+  if(replyLen){
+    NRF_sendPayload(buffer_reply, replyLen);
+    replyLen = 0;
+  }
+}
+
+// Send collected replies; replies to a poll addressed to all slaves are held back
+// until this slave's reply slot, the main loop calls this until they are out
+void flushReplies(){
+  if(replyScheduled){
+    if((int16_t)(TICK_now() - replyDue) < 0) return; // slot not there yet
+    replyScheduled = 0;
+  }
+  sendReplies();
+}
+
+// Pause the main loop for ms, sending scheduled replies when their slot comes
+void pauseLoop(uint8_t ms){
+  while(ms--){
+    DLY_ms(1);
+    if(replyScheduled) flushReplies();
+  }
+}
+
+// Add reply frame to the replies sent once the whole payload is processed
+void queueReply(__xdata uint8_t *frame, uint8_t len){
+  uint8_t i;
+  if(replyLen + len > NRF_PAYLOAD){
+    sendReplies();                                  // no room -> don't wait for slot
+  }
+  for(i=0; i<len; i++){
+    buffer_reply[replyLen++] = frame[i];
+  }
+}
+
+// Send reply frame in buffer_protocol, keep it for repetitions of a v2 frame
+void sendReply(){
+  uint8_t i;
+  if(seqSlot != SEQ_NONE){
+    for(i=0; i<PROTOCOL_LENGTH_V2; i++){
+      seqReply[seqSlot][i] = buffer_protocol[i];
+    }
+    seqReplyLen[seqSlot] = PROTOCOL_LENGTH_V2;
+  }
+  queueReply(buffer_protocol, frameLength);
+}
 
-  NRF_writePayload(buffer_protocol, PROTOCOL_LENGTH);           // send the buffer via NRF
+// Check SEQ of v2 frame against the window of frames applied last; a new SEQ
+// replaces the oldest entry. Returns 1 if the frame was applied already.
+uint8_t seqDuplicate(){
+  uint8_t i;
+  for(i=0; i<seqFill; i++){
+    if(seqWin[i] == buffer[P_SEQ]){
+      seqSlot = i;
+      return 1;
+    }
+  }
+  seqSlot = seqNext;
+  seqNext = (seqNext + 1) & (SEQ_WINDOW - 1);
+  if(seqFill < SEQ_WINDOW) seqFill++;
+  seqWin[seqSlot] = buffer[P_SEQ];
+  seqReplyLen[seqSlot] = 0;
+  return 0;
+}
 
+// Answer a repeated v2 frame with the reply cached for it, without applying it
+void seqReplay(){
+  if(seqReplyLen[seqSlot]){
+    queueReply(seqReply[seqSlot], seqReplyLen[seqSlot]);
+  }
+}
+
+void sendHelpMaster(){
+  fillReply(buffer_protocol, P_CODE_HELP, 0, 0);
+  NRF_sendPayload(buffer_protocol, PROTOCOL_LENGTH);            // send the buffer via NRF
 }
 
 void master_pause(){
+  startAt = 0;
   clockOn = 0;
   clockEnd = 0;
   displayDigits(1);
-  buffer_protocol[0] = 0x0A;
-  buffer_protocol[1] = MASTER_ID;
-  buffer_protocol[2] = NRF_id;
-  buffer_protocol[3] = 0xA6;
-  buffer_protocol[4] = 0;
-  buffer_protocol[5] = 0;
-  buffer_protocol[6] = buffer_protocol[1] + buffer_protocol[2] + buffer_protocol[3] + buffer_protocol[4]+ buffer_protocol[5];
-  buffer_protocol[7] = 0x0D;
-
-  NRF_writePayload(buffer_protocol, PROTOCOL_LENGTH);           // send the buffer via NRF
-
 }
 
 void master_start(){
+  startAt = 0;
   clockOn = 1;
   clockEnd = 0;
   displayDigits(1);
-  buffer_protocol[0] = 0x0A;
-  buffer_protocol[1] = MASTER_ID;
-  buffer_protocol[2] = NRF_id;
-  buffer_protocol[3] = 0xA5;
-  buffer_protocol[4] = 0;
-  buffer_protocol[5] = 0;
-  buffer_protocol[6] = buffer_protocol[1] + buffer_protocol[2] + buffer_protocol[3] + buffer_protocol[4]+ buffer_protocol[5];
-  buffer_protocol[7] = 0x0D;
-
-  NRF_writePayload(buffer_protocol, PROTOCOL_LENGTH);           // send the buffer via NRF
-
 }
 
 void master_resetTime(){
+  startAt = 0;
   clockEnd = 0;
   clockOn = 0;
-  display_timeseconds = 0;
-  fillBufferTime();
+  setSeconds(0);
   displayDigits(1);
-
-  buffer_protocol[0] = 0x0A;
-  buffer_protocol[1] = MASTER_ID;
-  buffer_protocol[2] = NRF_id;
-  buffer_protocol[3] = 0xA4;
-  buffer_protocol[4] = 0;
-  buffer_protocol[5] = 0;
-  buffer_protocol[6] = buffer_protocol[1] + buffer_protocol[2] + buffer_protocol[3] + buffer_protocol[4]+ buffer_protocol[5];
-  buffer_protocol[7] = 0x0D;
-
-  NRF_writePayload(buffer_protocol, PROTOCOL_LENGTH);           // send the buffer via NRF
-
 }
 
 void master_setTime(){
@@ -280,183 +358,239 @@ void master_setTime(){
   unsigned int minutes = buffer[P_MSG_HIGH];
   minutes = minutes<<8;
   minutes |= buffer[P_MSG_LOW];
-  display_timeseconds = minutes*60;
-  fillBufferTime();
+  setSeconds(minutes*60);
   displayDigits(1);
+}
 
-  buffer_protocol[0] = 0x0A;
-  buffer_protocol[1] = MASTER_ID;
-  buffer_protocol[2] = NRF_id;
-  buffer_protocol[3] = 0xA3;
-  buffer_protocol[4] = 0;
-  buffer_protocol[5] = 0;
-  buffer_protocol[6] = buffer_protocol[1] + buffer_protocol[2] + buffer_protocol[3] + buffer_protocol[4]+ buffer_protocol[5];
-  buffer_protocol[7] = 0x0D;
+// Lock wall clock to master time in beacon, corrected by the time since reception
+void master_beacon(){
+  uint8_t seconds = P_TIME_SECONDS(buffer[P_MSG_HIGH], buffer[P_MSG_LOW]);
+  uint16_t phase  = P_TIME_PHASE(buffer[P_MSG_HIGH], buffer[P_MSG_LOW]);
+  phase += TICK_now() - NRF_rxStamp;
+  while(phase >= 1000){
+    phase -= 1000;
+    seconds++;
+  }
+  TICK_sync(seconds & 0x3F, phase);
+}
 
-  NRF_writePayload(buffer_protocol, PROTOCOL_LENGTH);           // send the buffer via NRF
+// Start countdown when the wall clock reaches the given master second
+void master_startAt(){
+  startAt = 0x80 | (buffer[P_MSG_HIGH] & 0x3F);
+}
 
+// Listen at data rate requested by the master (replies keep the configured rate)
+void master_setRate(){
+  if(buffer[P_MSG_HIGH] > 2){
+    return;
+  }
+  linkSpeed = buffer[P_MSG_HIGH];
+  NRF_setRxSetup(NRF_SETUP[linkSpeed] | NRF_POWER[NRF_power]);
 }
 
-void master_replyTime(){
-  buffer_protocol[0] = 0x0A;
-  buffer_protocol[1] = MASTER_ID;
-  buffer_protocol[2] = NRF_id;
-  buffer_protocol[3] = 0xA2;
-  buffer_protocol[4] = display_timeseconds&0xFF;
-  buffer_protocol[5] = (display_timeseconds>>8)&0xFF;
-  buffer_protocol[6] = buffer_protocol[1] + buffer_protocol[2] + buffer_protocol[3] + buffer_protocol[4]+ buffer_protocol[5];
-  buffer_protocol[7] = 0x0D;
+// Return to configured data rate if the master has gone quiet (e.g. it lost us
+// after a rate change and fell back)
+void checkLink(){
+  if(linkSpeed == NRF_speed){
+    return;
+  }
+  if(++linkIdle >= 2*LINK_TIMEOUT){
+    linkSpeed = NRF_speed;
+    NRF_setRxSetup(NRF_txSetup);
+  }
+}
 
-  NRF_writePayload(buffer_protocol, PROTOCOL_LENGTH);           // send the buffer via NRF
+// Status high byte of hello reply: help request and time-up state
+uint8_t helloStatusHigh(){
+  if(askForHelp){
+    if(clockEnd){
+      return P_HELLO_HELP_END;
+    } else {
+      return P_HELLO_HELP;
+    }
+  }
+  if(clockEnd){
+    return P_HELLO_END;
+  }
+  return P_HELLO_IDLE;
 }
 
-void master_replyHello(){
-  if(buffer[P_MSG_HIGH]==0xA1){
-    configChanged = 0;
-    timeChanged = 0;
-  } else {
-    buffer_protocol[0] = 0x0A;
-    buffer_protocol[1] = MASTER_ID;
-    buffer_protocol[2] = NRF_id;
-    buffer_protocol[3] = 0xA1;
-    // Configure high byte
-    if(askForHelp){
-      if(clockEnd){
-        buffer_protocol[4] = 0x01;
+// Status low byte of hello reply: local changes not yet seen by master
+uint8_t helloStatusLow(){
+  if(configChanged){
+    if(timeChanged){
+      if(clockOn){
+        return 0x01;
       } else {
-        buffer_protocol[4] = 0x02;
+        return 0x02;
       }
-      
     } else {
-      if(1){
-        if(clockEnd){
-          buffer_protocol[4] = 0x03;
-        } else {
-          buffer_protocol[4] = 0x04;
-        }
+      if(clockOn){
+        return 0x03;
       } else {
-        buffer_protocol[4] = 0x00;
+        return 0x04;
       }
-      
-    }
-    
-    // Configure low byte
-    if(configChanged){
-      if(timeChanged){
-        if(clockOn){
-          buffer_protocol[5] = 0x01;
-        } else {
-          buffer_protocol[5] = 0x02;
-        }
-      } else {
-        if(clockOn){
-          buffer_protocol[5] = 0x03;
-        } else {
-          buffer_protocol[5] = 0x04;
-        }
-      }
-    } else {
-      buffer_protocol[5] = 0x00;
     }
-  
+  }
+  return 0x00;
+}
 
-    buffer_protocol[6] = buffer_protocol[1] + buffer_protocol[2] + buffer_protocol[3] + buffer_protocol[4]+ buffer_protocol[5];
-    buffer_protocol[7] = 0x0D;
+#if NRF_ACK_PAYLOAD
+// Preload hello and time reply as ACK payload, so that a poll addressed to this
+// slave is answered within the auto-ACK
+void loadAckPayload(){
+  unsigned int seconds = getTime();
+  fillReply(buffer_ack, P_REPLY_HELLO, helloStatusHigh(), helloStatusLow());
+  fillReply(buffer_ack + PROTOCOL_LENGTH, P_REPLY_TIME, seconds&0xFF, (seconds>>8)&0xFF);
+  NRF_writeAckPayload(buffer_ack, 2*PROTOCOL_LENGTH);
+  ackReload = 0;
+}
+
+// Check if the poll in buffer was already answered by the ACK payload; it holds
+// both hello and time reply, so it answers every poll packed into the payload
+uint8_t answeredByAck(){
+  return((buffer[P_TO] == NRF_id) && NRF_ackSent);
+}
+#else
+#define answeredByAck() 0
+#endif
+
+// Schedule the replies of this payload for this slave's reply slot after a poll
+// addressed to all slaves, so that the replies of the fleet don't collide; the
+// main loop goes on meanwhile and flushReplies() sends them when the slot comes
+void scheduleReply(){
+  #if NRF_RX_STAMP
+  replyDue = NRF_rxStamp;                           // slots count from reception
+  #else
+  replyDue = TICK_now();
+  #endif
+  replyDue += P_SLOT_BASE + P_SLOT(NRF_id) * P_SLOT_MS;
+  replyScheduled = 1;
+}
 
-    NRF_writePayload(buffer_protocol, PROTOCOL_LENGTH);           // send the buffer via NRF
+void master_replyTime(){
+  if(answeredByAck()){
+    return;
+  }
+  unsigned int seconds = getTime();
+  fillReply(buffer_protocol, P_REPLY_TIME, seconds&0xFF, (seconds>>8)&0xFF);
+  if(buffer[P_TO] == BROADCAST_ID){
+    scheduleReply();
+  }
+  sendReply();                                                  // send the buffer via NRF
+}
+
+void master_replyHello(){
+  unsigned int seconds;
+  if(buffer[P_MSG_HIGH]==P_REPLY_HELLO){
+    configChanged = 0;
+    timeChanged = 0;
+  } else if(buffer[P_TO] == BROADCAST_ID){
+    seconds = getTime();                                        // whole state in one slot
+    fillReply(buffer_protocol, P_REPLY_HELLO, helloStatusHigh(), helloStatusLow());
+    fillReply(buffer_protocol + frameLength, P_REPLY_TIME, seconds&0xFF, (seconds>>8)&0xFF);
+    scheduleReply();
+    queueReply(buffer_protocol, 2*frameLength);
+  } else if(!answeredByAck()){
+    fillReply(buffer_protocol, P_REPLY_HELLO, helloStatusHigh(), helloStatusLow());
+    sendReply();                                                // send the buffer via NRF
   }
   
 }
 
-uint8_t checksumCorrect(){
-  uint8_t ch = 0;
-  for(uint8_t i=P_TO; i<P_CHECKSUM; i++){
-    ch += buffer[i];
+// ===================================================================================
+// Message Dispatcher
+// ===================================================================================
+// One table entry per message code: the handler applies the message, then the
+// dispatcher sends the reply frame, if any. Handlers with reply code 0 answer
+// themselves (polls) or not at all.
+
+#define MSG_POLL          0x01                // no side effects, repetitions are answered anew
+#define MSG_UNICAST       0x02                // ignored when addressed to all slaves
+#define MSG_QUIET         0x04                // not logged (frequent)
+
+typedef struct _MESSAGE {
+  void (*handler)(void);                      // applies the message
+  uint8_t reply;                              // code of reply frame, 0: none
+  uint8_t flags;                              // MSG_* flags
+} MESSAGE;
+
+__code MESSAGE MESSAGES[P_CODES] = {
+  {0,                 0,             0},
+  {master_replyHello, 0,             MSG_POLL},     // P_CODE_HELLO
+  {master_replyTime,  0,             MSG_POLL},     // P_CODE_TIME
+  {master_setTime,    P_REPLY_SET,   0},            // P_CODE_SET
+  {master_resetTime,  P_REPLY_RESET, 0},            // P_CODE_RESET
+  {master_start,      P_REPLY_START, 0},            // P_CODE_START
+  {master_pause,      P_REPLY_PAUSE, 0},            // P_CODE_PAUSE
+  {0,                 0,             0},            // P_CODE_HELP
+  {master_setRate,    0,             MSG_UNICAST},  // P_CODE_RATE
+  {master_beacon,     0,             MSG_QUIET},    // P_CODE_BEACON
+  {0,                 0,             0},
+  {master_startAt,    0,             0}             // P_CODE_START_AT
+};
+
+void processFrame(uint8_t length){
+  __code MESSAGE *msg;
+  uint8_t result = P_check(buffer, length);
+  if(result != P_OK){
+    LOG_error(LOG_EV_FRAME, result);
+    return;
+  }
+  if(buffer[P_FROM] != MASTER_ID){
+    LOG_error(LOG_EV_MASTER_ID, buffer[P_FROM]);
+    return;
+  }
+  linkIdle = 0;
+  if((buffer[P_TO] != NRF_id) && (buffer[P_TO] != BROADCAST_ID)){
+    LOG_debug(LOG_EV_SLAVE_ID, buffer[P_TO]);
+    return;
+  }
+  if((buffer[P_CODE] >= P_CODES) || !MESSAGES[buffer[P_CODE]].handler){
+    LOG_error(LOG_EV_CODE, buffer[P_CODE]);
+    return;
+  }
+  msg = &MESSAGES[buffer[P_CODE]];
+  if((msg->flags & MSG_UNICAST) && (buffer[P_TO] != NRF_id)){
+    return;
   }
-  if(ch == buffer[P_CHECKSUM]){
-    return 1;
-  } else {
-    return 0;
+  seqSlot = SEQ_NONE;                           // polls don't push commands out of window
+  if((frameLength == PROTOCOL_LENGTH_V2) && !(msg->flags & MSG_POLL) && seqDuplicate()){
+    seqReplay();                                // applied already
+    LOG_info(LOG_EV_DUPLICATE, buffer[P_SEQ]);
+    return;
+  }
+  msg->handler();
+  if(msg->reply){
+    fillReply(buffer_protocol, msg->reply, 0, 0);
+    sendReply();                                // send the buffer via NRF
+  }
+  if(!(msg->flags & MSG_QUIET)){
+    LOG_info(LOG_EV_MESSAGE, buffer[P_CODE]);
   }
 }
 
-
+// Process every v1 or v2 frame packed into the received payload, each one moved to
+// the front of buffer in turn, and answer them in one payload; replies outside of
+// a request are v1
 void processBuffer(uint8_t length){
-  if(length==PROTOCOL_LENGTH){
-    if((buffer[P_START] == 0x0A)&&(buffer[P_END] == 0x0D)){
-      if(checksumCorrect()){
-        if(buffer[P_FROM]==MASTER_ID){  
-          if((buffer[P_TO] == NRF_id)||(buffer[P_TO] == 0)){
-            switch(buffer[P_CODE]){
-              case 1:
-                master_replyHello();
-                if(DEBUG_MODE){
-                  CDC_println("Replayed Hello");
-                }              
-                break;
-              case 2:
-                master_replyTime();
-                if(DEBUG_MODE){
-                  CDC_println("Replayed Time");
-                }              
-                break;
-              case 3:
-                master_setTime();
-                if(DEBUG_MODE){
-                  CDC_println("Set Time");
-                }
-                break;
-              case 4:
-                master_resetTime();
-                if(DEBUG_MODE){
-                  CDC_println("Time reseted");
-                }
-                break;
-              case 5:
-                master_start();
-                if(DEBUG_MODE){
-                  CDC_println("Timer started");
-                }
-                
-                break;
-              case 6:
-                master_pause();
-                if(DEBUG_MODE){
-                  CDC_println("Time paused");
-                }
-                break;
-              default:
-              if(DEBUG_MODE){
-                  CDC_println("Unknown Code");
-              }  
-            }
-          } else {
-            if(DEBUG_MODE){
-              CDC_println("Incorrect Slave ID");
-            }  
-          }
-        } else {
-          if(DEBUG_MODE){
-          CDC_println("Incorrect Master ID");
-        }
-        }
-      } else {
-        if(DEBUG_MODE){
-          CDC_println("Incorrect Checksum");
-        }
-      }
-
-    }else {
-      if(DEBUG_MODE){
-       CDC_println("Incorrect start or ending character");
-      }
+  uint8_t i, flen;
+  while(length){
+    frameLength = P_FRAME_LENGTH(buffer[P_START]);
+    flen = (length < frameLength) ? length : frameLength;
+    processFrame(flen);
+    length -= flen;
+    for(i=0; i<length; i++){
+      buffer[i] = buffer[i + flen];                 // next frame to the front
     }
-  } else {
-    if(DEBUG_MODE){
-      CDC_println("Incorrect Length");
-    }  
   }
+  frameLength = PROTOCOL_LENGTH;
+  flushReplies();
+  #if NRF_ACK_PAYLOAD
+  NRF_ackSent = 0;                                  // ACK payload is used up
+  #endif
 }
+
 // ===================================================================================
 // Main Function
 // ===================================================================================
@@ -473,6 +607,8 @@ void main(void) {
   FLASH_readSettings();                             // read user settings from flash
   CDC_init();                                       // init USB CDC
   NRF_init();                                       // init nRF24L01+
+  TICK_init();                                      // start millisecond tick
+  linkSpeed = NRF_speed;                            // listening at configured rate
 
   SPI_init();
   initialize();
@@ -487,9 +623,7 @@ void main(void) {
       buttonPressed = ADC_BUTTONSGetButton(ADC_CHANNEL);  
                                                           
       if((buttonLast!=buttonPressed)&&(buttonPressed!=0)){
-        if(DEBUG_MODE){
-          CDC_printByte(buttonPressed);
-        }
+        LOG_info(LOG_EV_BUTTON, buttonPressed);
         if(buttonPressed == 5){
           askForHelp = 1;
         }
@@ -504,6 +638,7 @@ void main(void) {
               displayDigits(1);
               break;
             case 2: 
+              startAt = 0;
               clockOn = 0;
               configChanged = 1;
               clockEnd = 0;
@@ -557,8 +692,6 @@ void main(void) {
       } 
       buttonLast = buttonPressed;
       
-      updateTimer++;
-      
       if(keyboardActive){
                  
         keyboardtimeout--;
@@ -572,13 +705,17 @@ void main(void) {
         }
       }
       
-      if(updateTimer >= 20){
-        updateTimer = 0;
-        dot = !dot;
+      if(halfSeconds){                              // tick interrupt passed half a second
+        halfSeconds = 0;
+        dot = !secondHalf;
+        checkLink();
+        #if NRF_ACK_PAYLOAD
+        ackReload = 1;                              // keep time/state in ACK current
+        #endif
         if(clockOn){
           if(dot){
-            decrementTime(1);
-            if(display_timeseconds==0){
+            fillBufferTime();                       // interrupt counted the second
+            if(getTime()==0){
               clockOn = 0;
               clockEnd = 1;
               SPEAKER_Generate(1);
@@ -598,31 +735,36 @@ void main(void) {
       //PIN_low(PIN_LED);                             // switch on LED
       bufptr = 0;                                   // reset buffer pointer
       buflen = NRF_readPayload(buffer);             // read payload into buffer
-      if(DEBUG_MODE){
-        CDC_printBytes(buffer,buflen);
-      }
+      LOG_debug(LOG_EV_RX, buflen);
       processBuffer(buflen);
+      #if NRF_ACK_PAYLOAD
+      ackReload = 1;                                // ACK payload used or state changed
+      #endif
       //while(buflen--) CDC_write(buffer[bufptr++]);  // write buffer via USB CDC
       //CDC_flush();                                  // flush CDC
     }
 
     buflen = CDC_available();                       // get number of bytes in CDC IN
     if(buflen) {                                    // something coming in via USB?
-      if(DEBUG_MODE){
-          CDC_println("CDC available");
-      }
-      bufptr = 0;                                   // reset buffer pointer
-      if(buflen > NRF_PAYLOAD) buflen = NRF_PAYLOAD;// restrict length to max payload
-      while(buflen--) buffer[bufptr++] = CDC_read();// get data from CDC
+      LOG_debug(LOG_EV_CDC, buflen);
+      bufptr = CDC_readBlock(buffer, NRF_PAYLOAD);  // get data from CDC
       if(buffer[0] == CMD_IDENT) parse();           // is it a command? -> parse
       if(buffer[0] == HELP_IDENT) printHelp();      // prints help
       else {                                        // not a command?
         
-        NRF_writePayload(buffer, bufptr);           // send the buffer via NRF
+        NRF_sendPayload(buffer, bufptr);            // send the buffer via NRF
       }
     }
 
-    DLY_ms(25);   
+    #if NRF_ACK_PAYLOAD
+    if(ackReload && (NRF_pollTX() != NRF_TX_BUSY)){
+      loadAckPayload();                             // refresh reply for next poll
+    }
+    #endif
+
+    NRF_pollTX();                                   // service pending transmission
+    LOG_flush();                                    // trace log to host if listening
+    pauseLoop(25);                                  // replies still go out in their slot
 
   }
   
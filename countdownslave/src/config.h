@@ -20,6 +20,18 @@
 // USB2NRF Settings
 #define NRF_PAYLOAD         32        // NRF max payload (1-32)
 #define NRF_CONFIG          0x0C      // CRC scheme, 0x08:8bit, 0x0C:16bit
+#define NRF_IRQ_RX          1         // 1: receive via INT1 on PIN_IRQ, 0: poll NRF
+#define NRF_RX_SLOTS        4         // RX ring buffer size in payloads (power of 2)
+#define NRF_ACK_PAYLOAD     0         // 1: poll replies in auto-ACK, single slave only:
+                                      // all slaves share one RX address, so several
+                                      // would ACK a poll and their payloads collide
+#define NRF_RX_STAMP        1         // 1: timestamp received payloads (tick.c)
+#define LINK_TIMEOUT        10        // s without master frame until back at own rate
+#define SEQ_WINDOW          4         // v2 frames remembered for duplicates (power of 2)
+#define LOG_LEVEL           2         // trace log: 0 off, 1 errors, 2 info, 3 debug
+#define LOG_RECORDS         16        // trace records buffered in XRAM (power of 2)
+#define CDC_TX_FIFO         64        // USB TX FIFO in bytes (power of 2, 64 - 128)
+#define CDC_TX_POLICY       CDC_DROP_NEWEST // full USB TX FIFO: CDC_DROP_NEWEST/OLDEST
 #define FLASH_IDENT         0xA96C    // to identify if data flash was written
 #define CMD_IDENT           '!'       // command string identifier
 #define HELP_IDENT          '?'       // help command
@@ -36,4 +48,5 @@
 #define MANUFACTURER_STR    'D','I','G','I','T','I','Z','E'
 #define PRODUCT_STR         'U','S','B','2','N','R','F'
 #define SERIAL_STR          'C','H','5','5','x','C','D','C'
+#define SERIAL_CHIP_ID      1         // 1: serial number from chip ID, 0: SERIAL_STR
 #define INTERFACE_STR       'C','D','C','-','S','e','r','i','a','l'
@@ -189,32 +189,49 @@ __code uint8_t number_p[] = {0b00011100,
 
 
 extern unsigned int display_counter = 0;
-extern unsigned int display_timeseconds = 0;
+volatile unsigned int display_timeseconds = 0;   // counted down by tick interrupt
 
 uint8_t display_buffer[DISPNUM];
 uint8_t display_digits[DISPNUM]; 
+__xdata uint8_t display_frame[2*DISPNUM];   // SPI block for the MAX7219 chain
 
 
-void setTime(unsigned int hours, unsigned int minutes){
-  display_timeseconds = hours*3600 + minutes*60;
+// display_timeseconds is decremented by the tick interrupt while the clock runs,
+// so it is only accessed with the interrupt held off
+unsigned int getTime(){
+  unsigned int seconds;
+  TICK_ATOMIC_BLOCK seconds = display_timeseconds;
+  return seconds;
+}
+
+void setSeconds(unsigned int seconds){
+  TICK_ATOMIC_BLOCK display_timeseconds = seconds;
   fillBufferTime();
 }
 
+void setTime(unsigned int hours, unsigned int minutes){
+  setSeconds(hours*3600 + minutes*60);
+}
+
 void decrementTime(unsigned int seconds){
-  if(display_timeseconds < seconds){
-    display_timeseconds = 0;
-  } else {
-    display_timeseconds -= seconds;
+  TICK_ATOMIC_BLOCK {
+    if(display_timeseconds < seconds){
+      display_timeseconds = 0;
+    } else {
+      display_timeseconds -= seconds;
+    }
   }
   fillBufferTime();
   
 }
 
 void incrementTime(unsigned int seconds){
-  if(display_timeseconds + seconds > 65000){
-    display_timeseconds = 65000;
-  } else {
-    display_timeseconds += seconds;
+  TICK_ATOMIC_BLOCK {
+    if(display_timeseconds + seconds > 65000){
+      display_timeseconds = 65000;
+    } else {
+      display_timeseconds += seconds;
+    }
   }
   fillBufferTime();
   
@@ -222,8 +239,9 @@ void incrementTime(unsigned int seconds){
 
 
 void fillBufferTime(){
-    unsigned int hours = display_timeseconds/3600;
-    unsigned int minutes = (display_timeseconds - hours*3600)/60;
+    unsigned int seconds = getTime();
+    unsigned int hours = seconds/3600;
+    unsigned int minutes = (seconds - hours*3600)/60;
     display_digits[3] = minutes%10;
     display_digits[2] = minutes/10;
     display_digits[1] = hours%10;
@@ -247,15 +265,17 @@ void sendCommandStealth(uint8_t msb, uint8_t lsb){
 }
 
 
+// The MAX7219 chain shifts on every SPI clock, so NRF traffic must not interleave;
+// the commands for all displays are shifted out as one block and latched together
 void sendBuffer(uint8_t address){
   for(uint8_t i=0; i<DISPNUM; i++){
-    if(i!=DISPNUM-1){
-      sendCommandStealth(address, display_buffer[(DISPNUM-1)-i ]);
-
-    } else {
-      sendCommand(address, display_buffer[(DISPNUM-1)-i ]);
-
-    }
+    display_frame[2*i]   = address;
+    display_frame[2*i+1] = display_buffer[(DISPNUM-1)-i];
+  }
+  NRF_ATOMIC_BLOCK {
+    PIN_low(PIN_DISP_CS);
+    SPI_writeBlock(display_frame, 2*DISPNUM);
+    PIN_high(PIN_DISP_CS);
   }
   
 
@@ -3,6 +3,8 @@
 #include "gpio.h"
 #include "config.h"
 #include "spi.h"
+#include "nrf24l01.h"
+#include "tick.h"
 
 
 extern __code uint8_t number_0[];
@@ -28,13 +30,15 @@ extern __code uint8_t number_u[];
 extern __code uint8_t number_p[];
 
 extern unsigned int display_counter;
-extern unsigned int display_timeseconds;
+extern volatile unsigned int display_timeseconds;
 
 #define DISPNUM 4
 
 extern uint8_t display_buffer[DISPNUM];
 extern uint8_t display_digits[DISPNUM]; 
 
+unsigned int getTime();
+void setSeconds(unsigned int seconds);
 void setTime(unsigned int minutes, unsigned int seconds);
 void decrementTime(unsigned int sec);
 void incrementTime(unsigned int sec);
@@ -0,0 +1,67 @@
+// ===================================================================================
+// Deferred Binary Trace Log for CH551, CH552 and CH554                       * v1.0 *
+// ===================================================================================
+
+#include "log.h"
+#include "tick.h"
+#include "usb_cdc.h"
+
+#if LOG_LEVEL
+
+#define LOG_RECORD        4             // bytes per record in ring (without LOG_MARK)
+#define LOG_BURST         12            // records per LOG_flush(), 60 bytes < EP2_SIZE
+
+__xdata uint8_t LOG_ring[LOG_RECORDS * LOG_RECORD];
+__xdata uint8_t LOG_head = 0;           // records written
+__xdata uint8_t LOG_tail = 0;           // records sent
+__xdata uint8_t LOG_dropped = 0;        // records lost, not yet reported
+
+// Write record into ring buffer
+void LOG_store(uint8_t event, uint8_t arg) {
+  __xdata uint8_t *ptr = LOG_ring + (LOG_head & (LOG_RECORDS - 1)) * LOG_RECORD;
+  uint16_t now = TICK_now();
+  ptr[0] = event;
+  ptr[1] = arg;
+  ptr[2] = now >> 8;
+  ptr[3] = now;
+  LOG_head++;
+}
+
+// Store record, preceded by the report of records lost before; count it as
+// dropped if the ring is full
+void LOG_event(uint8_t event, uint8_t arg) {
+  uint8_t used = LOG_head - LOG_tail;
+  uint8_t lost = LOG_dropped;
+  if(used + (lost ? 1 : 0) >= LOG_RECORDS) {
+    if(lost < 0xFF) LOG_dropped++;
+    return;
+  }
+  if(lost) {
+    LOG_dropped = 0;
+    LOG_store(LOG_EV_DROPPED, lost);
+  }
+  LOG_store(event, arg);
+}
+
+// Send stored records via CDC, only as many as fit into the endpoint at once, and
+// only if the host has DTR asserted and the CDC FIFO has room for them
+void LOG_flush(void) {
+  __xdata uint8_t *ptr;
+  uint8_t n;
+  if(!CDC_getDTR() || !CDC_ready()) return;
+  if(LOG_dropped && (LOG_tail == LOG_head)) {   // report loss even if all is quiet
+    LOG_store(LOG_EV_DROPPED, LOG_dropped);
+    LOG_dropped = 0;
+  }
+  for(n=LOG_BURST; n && (LOG_tail != LOG_head); n--, LOG_tail++) {
+    ptr = LOG_ring + (LOG_tail & (LOG_RECORDS - 1)) * LOG_RECORD;
+    CDC_write(LOG_MARK);
+    CDC_write(ptr[0]);
+    CDC_write(ptr[1]);
+    CDC_write(ptr[2]);
+    CDC_write(ptr[3]);
+  }
+  CDC_flush();
+}
+
+#endif
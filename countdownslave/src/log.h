@@ -0,0 +1,62 @@
+// ===================================================================================
+// Deferred Binary Trace Log for CH551, CH552 and CH554                       * v1.0 *
+// ===================================================================================
+//
+// Events are stored as compact records in an XRAM ring buffer and only sent via
+// USB CDC by LOG_flush() from the main loop, while the host has DTR asserted and
+// the CDC endpoint is free, so logging never waits for the host. Records that
+// don't fit into the ring are counted and reported by a LOG_EV_DROPPED record.
+//
+// Record on the wire (5 bytes): LOG_MARK | EVENT | ARG | TIME_HIGH | TIME_LOW
+// TIME is TICK_ms when the event was logged.
+//
+// LOG_LEVEL (config.h) selects which of LOG_error(), LOG_info() and LOG_debug()
+// are compiled in; the others compile to nothing.
+
+#pragma once
+#include <stdint.h>
+#include "config.h"
+
+#define LOG_LEVEL_OFF     0
+#define LOG_LEVEL_ERROR   1
+#define LOG_LEVEL_INFO    2
+#define LOG_LEVEL_DEBUG   3
+
+#define LOG_MARK          0x1E          // starts every record (ASCII record separator)
+
+// Event IDs
+#define LOG_EV_DROPPED    0x00          // ARG: records lost since last report
+#define LOG_EV_FRAME      0x01          // invalid frame, ARG: P_ERR_*
+#define LOG_EV_MASTER_ID  0x02          // frame not from master, ARG: FROM
+#define LOG_EV_SLAVE_ID   0x03          // frame for other slave, ARG: TO
+#define LOG_EV_CODE       0x04          // unknown message code, ARG: CODE
+#define LOG_EV_MESSAGE    0x10          // message applied, ARG: CODE
+#define LOG_EV_DUPLICATE  0x11          // repeated v2 frame, ARG: SEQ
+#define LOG_EV_BUTTON     0x12          // button pressed, ARG: button
+#define LOG_EV_RX         0x20          // payload received, ARG: length
+#define LOG_EV_CDC        0x21          // data from host, ARG: length
+
+#if LOG_LEVEL
+void LOG_event(uint8_t event, uint8_t arg); // store record in ring buffer
+void LOG_flush(void);                   // send stored records if host is listening
+#else
+#define LOG_flush()
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_error(event, arg)   LOG_event(event, arg)
+#else
+#define LOG_error(event, arg)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_info(event, arg)    LOG_event(event, arg)
+#else
+#define LOG_info(event, arg)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_debug(event, arg)   LOG_event(event, arg)
+#else
+#define LOG_debug(event, arg)
+#endif
@@ -0,0 +1,41 @@
+// ===================================================================================
+// Countdown Protocol Frame Encoder and Decoder                               * v1.0 *
+// ===================================================================================
+//
+// Shared by master (nrf2cdc) and slaves, so that both build and check frames the
+// same way. See protocol.h for the frame layout.
+
+#include "protocol.h"
+
+// Fill v1 frame
+void P_fill(__xdata uint8_t *frame, uint8_t to, uint8_t from, uint8_t code, uint8_t high, uint8_t low) {
+  frame[P_START]    = P_START_CHAR;
+  frame[P_TO]       = to;
+  frame[P_FROM]     = from;
+  frame[P_CODE]     = code;
+  frame[P_MSG_HIGH] = high;
+  frame[P_MSG_LOW]  = low;
+  frame[P_CHECKSUM] = to + from + code + high + low;
+  frame[P_END]      = P_END_CHAR;
+}
+
+// Turn v1 frame into v2 frame with sequence number seq (frame needs 9 bytes)
+void P_setSeq(__xdata uint8_t *frame, uint8_t seq) {
+  frame[P_START]    = P_START_CHAR_V2;
+  frame[P_SEQ]      = seq;
+  frame[P_CHECKSUM] += seq;
+  frame[P_END_V2]   = P_END_CHAR;
+}
+
+// Check len bytes at frame for a valid v1 or v2 frame, returns P_OK or P_ERR_*
+uint8_t P_check(__xdata uint8_t *frame, uint8_t len) {
+  uint8_t flen = P_FRAME_LENGTH(frame[P_START]);
+  uint8_t sum;
+  if(len != flen) return P_ERR_LENGTH;
+  if((frame[P_START] != P_START_CHAR) && (flen != PROTOCOL_LENGTH_V2)) return P_ERR_FRAME;
+  if(frame[flen - 1] != P_END_CHAR) return P_ERR_FRAME;
+  sum = frame[P_TO] + frame[P_FROM] + frame[P_CODE] + frame[P_MSG_HIGH] + frame[P_MSG_LOW];
+  if(flen == PROTOCOL_LENGTH_V2) sum += frame[P_SEQ];
+  if(sum != frame[P_CHECKSUM]) return P_ERR_CHECKSUM;
+  return P_OK;
+}
@@ -0,0 +1,94 @@
+// ===================================================================================
+// Countdown Protocol Definitions
+// ===================================================================================
+//
+// Frame layout (8 bytes):
+// START | TO | FROM | CODE | MSG_HIGH | MSG_LOW | CHECKSUM | END
+//
+// TO = 0 addresses all slaves, CHECKSUM is the byte sum of TO..MSG_LOW.
+//
+// Protocol v2 frame (9 bytes), recognized by START_V2:
+// START_V2 | TO | FROM | CODE | MSG_HIGH | MSG_LOW | CHECKSUM | SEQ | END
+//
+// CHECKSUM also covers SEQ. A slave applies each SEQ only once: a repeated frame
+// is answered with the cached reply instead, so lost ACKs can be retried safely.
+// Replies to v2 frames are v2 frames carrying the same SEQ.
+
+#pragma once
+#include <stdint.h>
+
+#define MASTER_ID         0xFF        // ID of the master (nrf2cdc)
+#define BROADCAST_ID      0x00        // TO field addressing all slaves
+
+#define PROTOCOL_LENGTH   8
+#define P_START           0
+#define P_TO              1
+#define P_FROM            2
+#define P_CODE            3
+#define P_MSG_HIGH        4
+#define P_MSG_LOW         5
+#define P_CHECKSUM        6
+#define P_END             7
+
+#define PROTOCOL_LENGTH_V2 9
+#define P_SEQ             7
+#define P_END_V2          8
+
+#define P_START_CHAR      0x0A        // first byte of a frame
+#define P_END_CHAR        0x0D        // last byte of a frame
+#define P_START_CHAR_V2   0x0B        // first byte of a v2 frame
+
+// Length of a frame by its first byte
+#define P_FRAME_LENGTH(start) (((start) == P_START_CHAR_V2) ? PROTOCOL_LENGTH_V2 : PROTOCOL_LENGTH)
+
+// Codes sent by the master
+#define P_CODE_HELLO      0x01        // poll slave status, slave answers P_REPLY_HELLO
+#define P_CODE_TIME       0x02        // poll slave time, slave answers P_REPLY_TIME
+#define P_CODE_SET        0x03        // set countdown to MSG minutes
+#define P_CODE_RESET      0x04        // stop countdown, set it to zero
+#define P_CODE_START      0x05        // start countdown
+#define P_CODE_PAUSE      0x06        // stop countdown
+#define P_CODE_HELP       0x07        // sent by a slave: help requested at the slave
+#define P_CODE_RATE       0x08        // listen at data rate MSG_HIGH (NRF_speed index)
+#define P_CODE_BEACON     0x09        // master time, broadcast periodically
+#define P_CODE_START_AT   0x0B        // start countdown at master second MSG_HIGH
+#define P_CODES           0x0C        // number of message codes (0 unused)
+
+// Codes of slave replies to the master
+#define P_REPLY_HELLO     0xA1        // MSG: status (help/time-up, unseen changes)
+#define P_REPLY_TIME      0xA2        // MSG_HIGH: seconds low byte, MSG_LOW: high byte
+#define P_REPLY_SET       0xA3        // countdown set
+#define P_REPLY_RESET     0xA4        // countdown reset
+#define P_REPLY_START     0xA5        // countdown started
+#define P_REPLY_PAUSE     0xA6        // countdown stopped
+
+// P_REPLY_HELLO MSG_HIGH: help request and time-up state of the slave
+#define P_HELLO_HELP_END  0x01        // help requested, time is up
+#define P_HELLO_HELP      0x02        // help requested
+#define P_HELLO_END       0x03        // time is up
+#define P_HELLO_IDLE      0x04        // neither
+
+// Reply slots: a hello/time poll addressed to all slaves is answered by each slave
+// in slot (ID - 1) mod P_SLOTS, P_SLOT_BASE + slot * P_SLOT_MS ms after reception;
+// the base covers the time a slave may take to get to the frame. A broadcast hello
+// is answered with hello and time reply in one payload.
+#define P_SLOTS           16          // reply slots (power of 2)
+#define P_SLOT_MS         4           // ms per reply slot
+#define P_SLOT_BASE       40          // ms from broadcast until first slot
+#define P_SLOT(id)        (((id) - 1) & (P_SLOTS - 1))
+
+// Master time in a beacon: MSG_HIGH bits 7-2 seconds (mod 64), MSG_HIGH bits 1-0 and
+// MSG_LOW milliseconds within the second (0-999)
+#define P_TIME_SECONDS(h, l)  ((h) >> 2)
+#define P_TIME_PHASE(h, l)    ((((uint16_t)(h) & 0x03) << 8) | (l))
+
+// Results of P_check()
+#define P_OK              0           // valid frame
+#define P_ERR_LENGTH      1           // length doesn't match START
+#define P_ERR_FRAME       2           // wrong START or END character
+#define P_ERR_CHECKSUM    3           // checksum mismatch
+
+// Frame encoder and decoder (protocol.c)
+void P_fill(__xdata uint8_t *frame, uint8_t to, uint8_t from, uint8_t code, uint8_t high, uint8_t low);
+void P_setSeq(__xdata uint8_t *frame, uint8_t seq);
+uint8_t P_check(__xdata uint8_t *frame, uint8_t len);
@@ -0,0 +1,63 @@
+// ===================================================================================
+// SPI Master Block Transfer Functions for CH551, CH552 and CH554            * v1.0 *
+// ===================================================================================
+//
+// Hand-written transfer loops for whole buffers in XRAM, shared by the drivers that
+// sit on the SPI bus (nRF24L01+, MAX7219). These loops keep pointer and counter in
+// DPTR/R7 and fetch/store the next byte while the current one is shifted out,
+// instead of the pointer and counter handling in internal RAM that SDCC generates
+// for "while(len--) SPI_transfer(*buf++)".
+//
+// Both functions are not reentrant (len is passed in internal RAM): callers from
+// main and from an interrupt must keep each other off the bus anyway.
+
+#include "spi.h"
+
+#pragma save
+#pragma nooverlay
+
+// SPI transmit len bytes from buffer, received bytes are discarded
+void SPI_writeBlock(__xdata uint8_t *buf, uint8_t len) {
+  buf;                          // stop unreferenced argument warning
+  len;
+  __asm
+    mov  a, _SPI_writeBlock_PARM_2
+    jz   03$                    ; nothing to send
+    mov  r7, a                  ; r7    <- len
+    01$:
+    movx a, @dptr               ; acc   <- *buf (while last byte is shifted out)
+    inc  dptr                   ; buf++
+    02$:
+    jnb  _S0_FREE, 02$          ; wait for SPI to get free
+    mov  _SPI0_DATA, a          ; start exchanging data byte
+    djnz r7, 01$                ; repeat len times
+    03$:
+    jnb  _S0_FREE, 03$          ; wait for last transfer to complete
+  __endasm;
+}
+
+// SPI receive len bytes into buffer, transmitting 0x00
+void SPI_readBlock(__xdata uint8_t *buf, uint8_t len) {
+  buf;                          // stop unreferenced argument warning
+  len;
+  __asm
+    mov  a, _SPI_readBlock_PARM_2
+    jz   04$                    ; nothing to receive
+    mov  r7, a                  ; r7    <- len
+    mov  _SPI0_DATA, #0         ; start exchanging first byte
+    01$:
+    jnb  _S0_FREE, 01$          ; wait for transfer to complete
+    mov  a, _SPI0_DATA          ; acc   <- received byte
+    djnz r7, 02$                ; more bytes to come?
+    movx @dptr, a               ; no  -> store last byte
+    sjmp 04$
+    02$:
+    mov  _SPI0_DATA, #0         ; yes -> start next byte
+    movx @dptr, a               ;        and store this one meanwhile
+    inc  dptr                   ; buf++
+    sjmp 01$
+    04$:
+  __endasm;
+}
+
+#pragma restore
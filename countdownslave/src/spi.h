@@ -37,3 +37,7 @@ inline uint8_t SPI_transfer(uint8_t data) {
   while(!S0_FREE);                    // wait for transfer to complete
   return SPI0_DATA;                   // return received byte
 }
+
+// SPI block transfers (src/spi.c), CS must be driven by the caller
+void SPI_writeBlock(__xdata uint8_t *buf, uint8_t len); // transmit buffer
+void SPI_readBlock(__xdata uint8_t *buf, uint8_t len);  // receive into buffer
@@ -0,0 +1,30 @@
+// ===================================================================================
+// Millisecond Tick Functions for CH551, CH552 and CH554                      * v1.0 *
+// ===================================================================================
+//
+// Timer2 runs in 16-bit auto-reload mode from Fsys and overflows once per
+// millisecond. Timestamps are 16-bit and wrap after 65.5 seconds, so always
+// compare differences: (uint16_t)(TICK_now() - start).
+//
+// Besides the free running TICK_ms there is a wall clock of seconds and
+// milliseconds within the second (TICK_seconds, TICK_phase). A slave locks this
+// clock to the master's with TICK_sync(): small errors are slewed out by running
+// the clock at double or zero speed, so no second boundary is skipped or repeated.
+
+#pragma once
+#include <stdint.h>
+#include "ch554.h"
+
+extern volatile uint16_t TICK_ms;         // milliseconds since TICK_init()
+extern volatile __xdata uint16_t TICK_phase;    // milliseconds within current second
+extern volatile __xdata uint16_t TICK_seconds;  // wall clock seconds
+extern volatile __bit TICK_halfSecond;    // set at every full and half second
+
+// keep tick interrupt off shared data, ET2 is left as found (nested use)
+#define TICK_ATOMIC_BLOCK for(uint8_t _et2 = ET2 | 2; _et2 && !(ET2 = 0); ET2 = _et2 & 1, _et2 = 0)
+#define TICK_SLEW_MAX     500             // larger clock errors are corrected at once
+
+void TICK_init(void);                     // start 1ms tick on Timer2
+void TICK_interrupt(void);                // Timer2 interrupt handler
+uint16_t TICK_now(void);                  // read millisecond counter
+void TICK_sync(uint8_t seconds, uint16_t phase);  // lock wall clock (seconds mod 64)
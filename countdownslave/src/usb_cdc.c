@@ -20,8 +20,40 @@ __xdata CDC_LINE_CODING_TYPE CDC_lineCoding = {
 volatile __xdata uint8_t CDC_controlLineState = 0;  // control line state
 volatile __xdata uint8_t CDC_readByteCount = 0;     // number of data bytes in IN buffer
 volatile __xdata uint8_t CDC_readPointer   = 0;     // data pointer for fetching
-volatile __xdata uint8_t CDC_writePointer  = 0;     // data pointer for writing
+volatile __xdata uint8_t CDC_readNextPointer = 0;   // start of the other OUT bank
+volatile __xdata uint8_t CDC_readNextCount = 0;     // bytes waiting in the other OUT bank
+volatile __xdata uint8_t CDC_writeStaged   = 0;     // bytes waiting in the idle IN bank
 volatile __bit CDC_writeBusyFlag = 0;               // flag of whether upload pointer is busy
+volatile __bit CDC_inBank = 0;                      // IN bank (data toggle) armed or armed next
+volatile __xdata uint8_t CDC_serialState = 0;       // SERIAL_STATE last sent to host
+volatile __xdata uint8_t CDC_serialNext  = 0;       // SERIAL_STATE to be sent
+volatile __bit CDC_notifyBusyFlag = 0;              // notification waiting on EP1
+
+// EP2 runs ping-pong in both directions, the data toggle selects the 64-byte bank:
+// OUT DATA0/DATA1 at EP2_buffer+0/+64, IN DATA0/DATA1 at EP2_buffer+128/+192.
+// While the SIE works on one bank, the firmware reads or fills the other one.
+// The IN bank is tracked in CDC_inBank: the toggle flips as soon as a transfer
+// completes, even while the interrupt is held off, so it is only read when idle.
+#define CDC_OUT_BANK(tog)       ((tog) ?  64 :   0)
+#define CDC_IN_BANK(tog)        ((tog) ? 192 : 128)
+
+// Whether FIFO bytes may go out right away: any in flush-per-packet mode, only a
+// full packet in throughput mode, the SOF handler uploads the rest once per frame
+#define CDC_DUE() (CDC_coalesce ? ((uint8_t)(CDC_txHead - CDC_txTail) >= EP2_SIZE) \
+                                : (CDC_txHead != CDC_txTail))
+
+// Transmit FIFO, the main loop advances the head, EP2 IN uploads advance the tail.
+// Both indices run freely and are masked on access, head - tail is the fill level.
+__xdata uint8_t CDC_txFifo[CDC_TX_FIFO];            // bytes waiting for upload
+volatile __xdata uint8_t CDC_txHead = 0;            // bytes written to FIFO
+volatile __xdata uint8_t CDC_txTail = 0;            // bytes moved to EP2 IN buffer
+volatile __xdata uint16_t CDC_txDropped = 0;        // bytes lost to FIFO overflow
+volatile __xdata uint8_t CDC_txPeak = 0;            // highest FIFO fill level seen
+volatile __xdata uint16_t CDC_txFlushes = 0;        // CDC_flush() calls
+volatile __xdata uint16_t CDC_txPackets = 0;        // IN packets uploaded
+volatile __xdata uint16_t CDC_txBytes   = 0;        // bytes in these packets
+volatile __bit CDC_coalesce = CDC_COALESCE;         // 1: throughput mode (SOF-timed)
+__bit CDC_printStuck = 0;                            // host stopped reading, print drops
 
 // CDC class requests
 #define SET_LINE_CODING         0x20  // host configures line coding
@@ -29,31 +61,168 @@ volatile __bit CDC_writeBusyFlag = 0;               // flag of whether upload po
 #define SET_CONTROL_LINE_STATE  0x22  // generates RS-232/V.24 style control signals
 #define SEND_BREAK              0x23  // send break
 
+// CDC notifications
+#define SERIAL_STATE            0x20  // UART state bitmap, sent via EP1
+
+// ===================================================================================
+// Fast Copy Function
+// ===================================================================================
+// Copy len bytes from XRAM src to XRAM dst using both data pointers; the USB
+// interrupt is held off meanwhile (USB_EP0_copyDescr() uses DPTR1 as well) and
+// left as found, so callers may run with it already disabled
+#pragma callee_saves CDC_copy
+void CDC_copy(__xdata uint8_t *dst, __xdata uint8_t *src, uint8_t len) {
+  dst; src; len;                // stop unreferenced argument warning
+  __asm
+    push acc                    ; acc -> stack
+    push ar7                    ; r7  -> stack
+    push ar6                    ; r6  -> stack
+    mov  r7, _CDC_copy_PARM_3   ; r7  <- len
+    mov  a, r7
+    jz   02$                    ; nothing to copy
+    mov  r6, dpl                ; r6  <- dst low
+    mov  a, dph                 ; acc <- dst high
+    mov  c, _IE_USB             ; c   <- USB interrupt state
+    push psw                    ; c   -> stack
+    clr  _IE_USB                ; USB interrupt off
+    inc  _XBUS_AUX              ; select dptr1
+    mov  dpl, r6                ; dptr1 <- dst
+    mov  dph, a
+    dec  _XBUS_AUX              ; select dptr0
+    mov  dpl, _CDC_copy_PARM_2  ; dptr0 <- src
+    mov  dph, (_CDC_copy_PARM_2 + 1)
+    01$:
+    movx a, @dptr               ; acc <- src[dptr0]
+    inc  dptr                   ; inc dptr0
+    .db  0xA5                   ; acc -> dst[dptr1] & inc dptr1
+    djnz r7, 01$                ; repeat len times
+    pop  psw                    ; c   <- stack
+    mov  _IE_USB, c             ; USB interrupt state back
+    02$:
+    pop  ar6                    ; r6  <- stack
+    pop  ar7                    ; r7  <- stack
+    pop  acc                    ; acc <- stack
+  __endasm;
+}
+
 // ===================================================================================
 // Front End Functions
 // ===================================================================================
 
-// Flush the OUT buffer (upload to host)
+// Move up to one packet from FIFO to EP2 IN bank at offset, returns its length;
+// upload a loaded bank to host. These run in USB interrupt or in main loop with
+// USB interrupt disabled.
+#pragma save
+#pragma nooverlay
+uint8_t CDC_load(uint8_t offset) {
+  uint8_t i;
+  uint8_t len = CDC_txHead - CDC_txTail;          // bytes waiting in FIFO
+  if(len > EP2_SIZE) len = EP2_SIZE;              // one packet at a time
+  for(i=0; i<len; i++)
+    EP2_buffer[offset + i] = CDC_txFifo[(uint8_t)(CDC_txTail + i) & (CDC_TX_FIFO - 1)];
+  CDC_txTail += len;                              // release FIFO space
+  return len;
+}
+
+void CDC_upload(uint8_t len) {
+  CDC_txPackets++;                                // count packet and its fill
+  CDC_txBytes += len;
+  CDC_writeBusyFlag = 1;                          // busy until EP2 IN completes
+  UEP2_T_LEN = len;                               // number of bytes to upload
+  UEP2_CTRL  = (UEP2_CTRL & ~MASK_UEP_T_RES)
+             | UEP_T_RES_ACK;                     // upload data to host
+}
+#pragma restore
+
+// Flush the OUT buffer (upload to host). If the endpoint is busy, the next packet
+// goes to the idle IN bank, so the interrupt only has to arm it.
 void CDC_flush(void) {
-  if(!CDC_writeBusyFlag && CDC_writePointer) {    // not busy and buffer not empty?
-    CDC_writeBusyFlag = 1;                        // busy for now
-    UEP2_T_LEN = CDC_writePointer;                // number of bytes to upload
-    UEP2_CTRL  = (UEP2_CTRL & ~MASK_UEP_T_RES)
-               | UEP_T_RES_ACK;                   // upload data to host
-    CDC_writePointer = 0;                         // reset write pointer
+  CDC_txFlushes++;                                // count flush request
+  IE_USB = 0;                                     // keep EP2 IN handler out
+  if(!CDC_writeBusyFlag && CDC_DUE()) {
+    CDC_inBank = (UEP2_CTRL & bUEP_T_TOG) ? 1 : 0; // idle -> toggle is stable
+    CDC_upload(CDC_load(CDC_IN_BANK(CDC_inBank)));
   }
+  if(CDC_writeBusyFlag && !CDC_writeStaged && CDC_DUE())
+    CDC_writeStaged = CDC_load(CDC_IN_BANK(!CDC_inBank)); // never the armed bank
+  IE_USB = 1;
 }
 
-// Write single character to OUT buffer
-void CDC_write(char c) {
-  while(CDC_writeBusyFlag);                       // wait for ready to write
-  EP2_buffer[64 + CDC_writePointer++] = c;        // write character to buffer
-  if(CDC_writePointer == EP2_SIZE) CDC_flush();   // flush if buffer full
+// Write single character to OUT buffer, never waits for the host
+uint8_t CDC_write(char c) {
+  uint8_t fill = CDC_txHead - CDC_txTail;         // current FIFO fill level
+  if(fill >= CDC_TX_FIFO) {                       // FIFO full?
+    #if CDC_TX_POLICY == CDC_DROP_OLDEST
+    IE_USB = 0;                                   // tail belongs to EP2 IN handler
+    if((uint8_t)(CDC_txHead - CDC_txTail) >= CDC_TX_FIFO) {
+      CDC_txTail++;                               // discard oldest byte
+      CDC_txDropped++;                            // count lost byte
+    }
+    fill = CDC_txHead - CDC_txTail;
+    IE_USB = 1;
+    #else
+    CDC_txDropped++;                              // count lost byte
+    return 0;                                     // discard this byte
+    #endif
+  }
+  CDC_txFifo[CDC_txHead & (CDC_TX_FIFO - 1)] = c; // write character to FIFO
+  CDC_txHead++;
+  if(++fill > CDC_txPeak) CDC_txPeak = fill;      // track high water mark
+  if(fill >= EP2_SIZE) CDC_flush();               // flush if a packet is full
+  return 1;
 }
 
-// Write string to OUT buffer
+// Write block to OUT buffer, returns number of bytes accepted. Room is checked
+// once for the whole block, which goes to the FIFO in at most two copies.
+uint8_t CDC_writeBlock(__xdata uint8_t *buf, uint8_t len) {
+  uint8_t head, cnt;
+  uint8_t room = CDC_TX_FIFO - (uint8_t)(CDC_txHead - CDC_txTail);
+  if(len > room) {                                // doesn't fit?
+    #if CDC_TX_POLICY == CDC_DROP_OLDEST
+    if(len > CDC_TX_FIFO) {                       // longer than FIFO?
+      CDC_txDropped += len - CDC_TX_FIFO;         // -> only its tail fits
+      buf += len - CDC_TX_FIFO;
+      len  = CDC_TX_FIFO;
+    }
+    IE_USB = 0;                                   // tail belongs to EP2 IN handler
+    room = CDC_TX_FIFO - (uint8_t)(CDC_txHead - CDC_txTail);
+    if(len > room) {
+      CDC_txTail    += len - room;                // discard oldest bytes
+      CDC_txDropped += len - room;                // count lost bytes
+    }
+    IE_USB = 1;
+    #else
+    CDC_txDropped += len - room;                  // count lost bytes
+    len = room;                                   // discard the rest
+    #endif
+  }
+  head = CDC_txHead & (CDC_TX_FIFO - 1);          // FIFO write position
+  cnt  = CDC_TX_FIFO - head;                      // room until wrap around
+  if(cnt > len) cnt = len;
+  CDC_copy(CDC_txFifo + head, buf, cnt);          // up to end of FIFO
+  CDC_copy(CDC_txFifo, buf + cnt, len - cnt);     // rest from start of FIFO
+  CDC_txHead += len;                              // publish block at once
+  cnt = CDC_txHead - CDC_txTail;                  // new fill level
+  if(cnt > CDC_txPeak) CDC_txPeak = cnt;          // track high water mark
+  if(cnt >= EP2_SIZE) CDC_flush();                // flush if a packet is full
+  return len;
+}
+
+// Write string to OUT buffer. Text answers a terminal, so wait for room while the
+// host holds DTR, but only as long as it keeps reading: if the FIFO stays full for
+// about 100ms, text falls back to CDC_TX_POLICY until the host frees room again.
+// Raw data written with CDC_write() or CDC_writeBlock() never waits.
 void CDC_print(char* str) {
-  while(*str) CDC_write(*str++);                  // write each char of string
+  uint16_t spins;
+  if(CDC_free()) CDC_printStuck = 0;              // host reads again
+  while(*str) {
+    spins = 0;
+    while(!CDC_free() && CDC_getDTR() && !CDC_printStuck) {
+      CDC_flush();                                // terminal open -> wait for room
+      if(!++spins) CDC_printStuck = 1;            // no progress -> stop waiting
+    }
+    CDC_write(*str++);                            // write each char of string
+  }
 }
 
 // Write string with newline to OUT buffer and flush
@@ -63,17 +232,71 @@ void CDC_println(char* str) {
   CDC_flush();                                    // flush OUT buffer
 }
 
+// Current OUT bank is read completely, continue with the other one if it was
+// filled meanwhile and let the host refill this one
+void CDC_nextBank(void) {
+  IE_USB = 0;                                     // keep EP2 OUT handler out
+  if(CDC_readNextCount) {                         // other bank filled meanwhile?
+    CDC_readPointer   = CDC_readNextPointer;      // -> continue there
+    CDC_readByteCount = CDC_readNextCount;
+    CDC_readNextCount = 0;
+    UEP2_CTRL = (UEP2_CTRL & ~MASK_UEP_R_RES)
+              | UEP_R_RES_ACK;                    // this bank is free again
+  }
+  IE_USB = 1;
+}
+
 // Read single character from IN buffer
 char CDC_read(void) {
   char data;
   while(!CDC_readByteCount);                      // wait for data
   data = EP2_buffer[CDC_readPointer++];           // get character
-  if(--CDC_readByteCount == 0)                    // dec number of bytes in buffer
-    UEP2_CTRL = (UEP2_CTRL & ~MASK_UEP_R_RES)
-              | UEP_R_RES_ACK;                    // request new data if empty
+  if(--CDC_readByteCount == 0) CDC_nextBank();    // dec number of bytes in bank
   return data;
 }
 
+// Read up to max bytes from IN buffer into buf, returns number of bytes read;
+// doesn't wait, takes one OUT bank at most and re-arms the endpoint once
+uint8_t CDC_readBlock(__xdata uint8_t *buf, uint8_t max) {
+  uint8_t len = CDC_readByteCount;                // bytes in current bank
+  if(!len) return 0;                              // nothing received
+  if(len > max) len = max;
+  CDC_copy(buf, EP2_buffer + CDC_readPointer, len); // copy block
+  CDC_readPointer += len;
+  CDC_readByteCount -= len;
+  if(!CDC_readByteCount) CDC_nextBank();          // bank done -> release it
+  return len;
+}
+
+// Load SERIAL_STATE notification into EP1 and arm it; runs in USB interrupt or in
+// main loop with USB interrupt disabled
+void CDC_notifyLoad(void) {
+  EP1_buffer[0] = 0xA1;                           // class request, interface to host
+  EP1_buffer[1] = SERIAL_STATE;                   // notification code
+  EP1_buffer[2] = 0;                              // wValue: zero
+  EP1_buffer[3] = 0;
+  EP1_buffer[4] = 0;                              // wIndex: CDC interface 0
+  EP1_buffer[5] = 0;
+  EP1_buffer[6] = 2;                              // wLength: 2 bytes of data
+  EP1_buffer[7] = 0;
+  EP1_buffer[8] = CDC_serialNext;                 // UART state bitmap
+  EP1_buffer[9] = 0;
+  CDC_serialState    = CDC_serialNext;            // this is what the host gets
+  CDC_notifyBusyFlag = 1;                         // busy until host took it
+  UEP1_T_LEN = 10;                                // notification length
+  UEP1_CTRL  = (UEP1_CTRL & ~MASK_UEP_T_RES)
+             | UEP_T_RES_ACK;                     // let host fetch it
+}
+
+// Send UART state bitmap (CDC_STATE_*) to host if it changed; while one is still
+// waiting on EP1, only the latest state follows
+void CDC_notify(uint8_t state) {
+  IE_USB = 0;                                     // keep EP1 IN handler out
+  CDC_serialNext = state;
+  if(!CDC_notifyBusyFlag && (state != CDC_serialState)) CDC_notifyLoad();
+  IE_USB = 1;
+}
+
 // ===================================================================================
 // CDC-Specific USB Handler Functions
 // ===================================================================================
@@ -87,12 +310,18 @@ void CDC_EP_init(void) {
   UEP2_CTRL   = bUEP_AUTO_TOG                     // EP2 Auto flip sync flag
               | UEP_T_RES_NAK                     // EP2 IN transaction returns NAK
               | UEP_R_RES_ACK;                    // EP2 OUT transaction returns ACK
-  UEP2_3_MOD  = bUEP2_RX_EN | bUEP2_TX_EN;        // EP2 double buffer (0x0C)
+  UEP2_3_MOD  = bUEP2_RX_EN | bUEP2_TX_EN
+              | bUEP2_BUF_MOD;                    // EP2 ping-pong in and out (0x0D)
   UEP4_1_MOD  = bUEP1_TX_EN;                      // EP1 TX enable (0x40)
   UEP1_T_LEN  = 0;                                // EP1 nothing to send
   UEP2_T_LEN  = 0;                                // EP2 nothing to send
   CDC_readByteCount = 0;                          // reset received bytes counter
+  CDC_readNextCount = 0;                          // both OUT banks free
+  CDC_writeStaged   = 0;                          // both IN banks free
   CDC_writeBusyFlag = 0;                          // reset write busy flag
+  CDC_txTail = CDC_txHead;                        // forget bytes from last session
+  CDC_notifyBusyFlag = 0;                         // no notification pending
+  CDC_serialState = 0;                            // host assumes all lines low
 }
 
 // Handle CLASS SETUP requests
@@ -123,22 +352,60 @@ void CDC_EP0_OUT(void) {
   UEP0_CTRL = bUEP_T_TOG | UEP_T_RES_ACK | UEP_R_RES_ACK;
 }
 
-// Endpoint 1 IN handler
-// No handling is actually necessary here, the auto-NAK is sufficient.
+// Endpoint 1 IN handler (notification taken by host)
+void CDC_EP1_IN(void) {
+  if(CDC_serialNext != CDC_serialState) {         // state changed meanwhile?
+    CDC_notifyLoad();                             // -> send the new one
+    return;
+  }
+  UEP1_CTRL  = (UEP1_CTRL & ~MASK_UEP_T_RES)
+             | UEP_T_RES_NAK;                     // -> respond NAK for now
+  CDC_notifyBusyFlag = 0;                         // clear busy flag
+}
 
 // Endpoint 2 IN handler (bulk data transfer to host completed)
+// The toggle has flipped to the other bank, which may already be staged.
 void CDC_EP2_IN(void) {
+  CDC_inBank = !CDC_inBank;                       // sent bank done, other one next
+  if(CDC_writeStaged) {                           // next packet already in bank?
+    CDC_upload(CDC_writeStaged);                  // -> just arm it
+    CDC_writeStaged = 0;
+    return;
+  }
+  if(CDC_DUE()) {                                 // more bytes to go in FIFO?
+    CDC_upload(CDC_load(CDC_IN_BANK(CDC_inBank)));
+    return;
+  }
   UEP2_CTRL  = (UEP2_CTRL & ~MASK_UEP_T_RES)
              | UEP_T_RES_NAK;                     // -> respond NAK for now
   CDC_writeBusyFlag = 0;                          // clear busy flag
 }
 
+// Start of frame handler (every 1ms): in throughput mode all bytes written during
+// the last frame go out in one packet now, full packets don't wait for it
+void CDC_SOF(void) {
+  if(!CDC_coalesce || CDC_writeBusyFlag || (CDC_txHead == CDC_txTail)) return;
+  CDC_inBank = (UEP2_CTRL & bUEP_T_TOG) ? 1 : 0;   // idle -> toggle is stable
+  CDC_upload(CDC_load(CDC_IN_BANK(CDC_inBank)));
+}
+
 // Endpoint 2 OUT handler (bulk data transfer from host completed)
+// The toggle has already flipped, so the packet is in the bank it doesn't select.
+// The host may fill the other bank while this one is read, only if both are full
+// the endpoint NAKs.
 void CDC_EP2_OUT(void) {
+  uint8_t bank;
   if(U_TOG_OK && USB_RX_LEN) {                    // received synchronized packet?
-    UEP2_CTRL = (UEP2_CTRL & ~MASK_UEP_R_RES)
-              | UEP_R_RES_NAK;                    // not ready to receive more for now
-    CDC_readByteCount = USB_RX_LEN;               // set number of received data bytes
-    CDC_readPointer   = 0;                        // reset read pointer for fetching
+    bank = CDC_OUT_BANK(!(UEP2_CTRL & bUEP_R_TOG)); // bank the packet went to
+    if(!CDC_readByteCount) {                      // reader idle?
+      CDC_readByteCount = USB_RX_LEN;             // set number of received data bytes
+      CDC_readPointer   = bank;                   // reset read pointer for fetching
+    }
+    else {                                        // reader still in other bank
+      CDC_readNextCount   = USB_RX_LEN;           // keep this one for later
+      CDC_readNextPointer = bank;
+      UEP2_CTRL = (UEP2_CTRL & ~MASK_UEP_R_RES)
+                | UEP_R_RES_NAK;                  // not ready to receive more for now
+    }
   }
 }
@@ -10,6 +10,7 @@
 volatile uint8_t  USB_SetupReq, USB_SetupTyp, USB_Config, USB_Addr;
 volatile uint16_t USB_SetupLen;
 volatile __bit    USB_ENUM_OK;
+volatile __bit    USB_descrXRAM;            // USB_pDescr points into XRAM
 __code uint8_t*   USB_pDescr;
 
 // ===================================================================================
@@ -37,10 +38,16 @@ void USB_init(void) {
   UDEV_CTRL   = bUD_PD_DIS                  // disable UDP/UDM pulldown resistor
               | bUD_PORT_EN;                // enable port, full-speed
 
+  #ifdef USB_STR_DESCR_XRAM
+  USB_initSerial();                         // build serial string in XRAM
+  #endif
   USB_EP_init();                            // setup endpoints
 
   USB_INT_EN  = bUIE_SUSPEND                // enable device hang interrupt
               | bUIE_TRANSFER               // enable USB transfer completion interrupt
+              #ifdef SOF_callback
+              | bUIE_DEV_SOF                // enable start of frame interrupt
+              #endif
               | bUIE_BUS_RST;               // enable device mode USB bus reset interrupt
 
   USB_INT_FG  = 0x1f;                       // clear interrupt flags
@@ -51,8 +58,8 @@ void USB_init(void) {
 // ===================================================================================
 // Fast Copy Function
 // ===================================================================================
-// Copy descriptor *USB_pDescr to EP0_buffer using double pointer
-// (Thanks to Ralph Doncaster)
+// Copy descriptor *USB_pDescr to EP0_buffer using double pointer, from code flash
+// or, if USB_descrXRAM is set, from XRAM (Thanks to Ralph Doncaster)
 #pragma callee_saves USB_EP0_copyDescr
 void USB_EP0_copyDescr(uint8_t len) {
   len;                          // stop unreferenced argument warning
@@ -65,12 +72,20 @@ void USB_EP0_copyDescr(uint8_t len) {
     dec  _XBUS_AUX              ; select dptr0
     mov  dpl, _USB_pDescr       ; dptr0 <- *USB_pDescr
     mov  dph, (_USB_pDescr + 1)
+    jb   _USB_descrXRAM, 02$    ; descriptor in XRAM?
     01$:
     clr  a                      ; acc <- #0
     movc a, @a+dptr             ; acc <- *USB_pDescr[dptr0]
     inc  dptr                   ; inc dptr0
     .db  0xA5                   ; acc -> EP0_buffer[dptr1] & inc dptr1
     djnz r7, 01$                ; repeat len times
+    sjmp 03$
+    02$:
+    movx a, @dptr               ; acc <- XRAM[dptr0]
+    inc  dptr                   ; inc dptr0
+    .db  0xA5                   ; acc -> EP0_buffer[dptr1] & inc dptr1
+    djnz r7, 02$                ; repeat len times
+    03$:
     mov  _USB_pDescr, dpl       ; USB_pDescr += len
     mov  (_USB_pDescr + 1), dph
     pop  ar7                    ; r7  <- stack
@@ -92,6 +107,7 @@ void USB_EP0_SETUP(void) {
   if((USB_SetupTyp & USB_REQ_TYP_MASK) == USB_REQ_TYP_STANDARD) {
     switch(USB_SetupReq) {                        // request type
       case USB_GET_DESCRIPTOR:
+        USB_descrXRAM = 0;                        // descriptors are in code flash
         switch(USB_SetupBuf->wValueH) {
 
           case USB_DESCR_TYP_DEVICE:              // Device Descriptor
@@ -133,6 +149,13 @@ void USB_EP0_SETUP(void) {
               #endif
               default:  USB_pDescr = USB_STR_DESCR_ix; break;
             }
+            #ifdef USB_STR_DESCR_XRAM
+            if(USB_SetupBuf->wValueL == USB_STR_DESCR_XRAM) { // built at runtime?
+              USB_descrXRAM = 1;                  // -> copy from XRAM
+              len = *(__xdata uint8_t*)USB_pDescr;  // descriptor length
+              break;
+            }
+            #endif
             len = USB_pDescr[0];                  // descriptor length
             break;
 
@@ -411,6 +434,12 @@ void USB_interrupt(void) {
         EP0_SETUP_callback();
         break;
 
+      #ifdef SOF_callback
+      case UIS_TOKEN_SOF:
+        SOF_callback();
+        break;
+      #endif
+
       case UIS_TOKEN_IN:
         switch (callIndex) {
           case 0: EP0_IN_callback(); break;
@@ -0,0 +1,25 @@
+// ===================================================================================
+// SDCC Keyword Shims for Host Builds of Hardware Independent Modules
+// ===================================================================================
+//
+// Lets gcc/clang compile modules like tick.c for tests on the build host: memory
+// space qualifiers vanish, SFRs and SBITs become plain variables the test drives.
+
+#pragma once
+
+#define __xdata
+#define __code
+#define __data
+#define __idata
+#define __pdata
+#define __reentrant
+#define __critical
+#define __naked
+#define __sfr     volatile unsigned char
+#define __sbit    volatile unsigned char
+#define __sfr16   volatile unsigned short
+#define __sfr32   volatile unsigned long
+#define __bit     unsigned char
+#define __at(x)
+#define __interrupt(x)
+#define __using(x)
@@ -0,0 +1,140 @@
+// ===================================================================================
+// Host Test for the Wall Clock Discipline of tick.c
+// ===================================================================================
+//
+// Drives TICK_interrupt() as the 1ms Timer2 overflow and TICK_sync() as received
+// master beacons, and checks slewing within TICK_SLEW_MAX, step corrections,
+// wrap-around of the seconds mod 64 and an hour-long countdown with a drifting
+// crystal and beacon latency. Run "make test".
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "../src/tick.c"
+
+static int failed = 0;
+
+#define CHECK(cond, ...) do { if(!(cond)) { printf("FAIL line %d: ", __LINE__); \
+                              printf(__VA_ARGS__); printf("\n"); failed++; } } while(0)
+
+// Wall clock in ms since a second 0
+static long clockMs(void) {
+  return (long)TICK_seconds * 1000 + TICK_phase;
+}
+
+// Set slave wall clock directly
+static void setClock(uint16_t seconds, uint16_t phase) {
+  TICK_seconds = seconds;
+  TICK_phase   = phase;
+  TICK_slew    = 0;
+}
+
+// Run n ticks, the wall clock must advance by 0, 1 or 2 ms per tick
+static void run(long n) {
+  long before;
+  while(n--) {
+    before = clockMs();
+    TICK_interrupt();
+    CHECK((clockMs() - before >= 0) && (clockMs() - before <= 2),
+          "clock jumped by %ld ms", clockMs() - before);
+  }
+}
+
+// Sync to master time given in ms, as the beacon carries it
+static void sync(long masterMs) {
+  TICK_sync((masterMs / 1000) & 0x3F, masterMs % 1000);
+}
+
+// Errors up to TICK_SLEW_MAX are slewed out without a jump
+static void testSlew(void) {
+  long error;
+  for(error = -TICK_SLEW_MAX; error <= TICK_SLEW_MAX; error += 50) {
+    setClock(100, 300);
+    sync(100300 + error);
+    CHECK(TICK_slew == error, "slew %d for error %ld", TICK_slew, error);
+    CHECK(clockMs() == 100300, "clock set at once for error %ld", error);
+    run(TICK_SLEW_MAX + 10);
+    CHECK(clockMs() == 100300 + error + TICK_SLEW_MAX + 10,
+          "error %ld left %ld ms", error, clockMs() - (100300 + error + TICK_SLEW_MAX + 10));
+  }
+}
+
+// Larger errors set the clock at once
+static void testStep(void) {
+  static const long errors[] = {TICK_SLEW_MAX + 1, -TICK_SLEW_MAX - 1, 1700, -1700,
+                                5000, -5000, 30000, -30000};
+  uint8_t i;
+  for(i=0; i<sizeof(errors)/sizeof(errors[0]); i++) {
+    setClock(200, 400);
+    sync(200400 + errors[i]);
+    CHECK(clockMs() == 200400 + errors[i], "step %ld gave %ld ms off",
+          errors[i], clockMs() - (200400 + errors[i]));
+    CHECK(TICK_slew == 0, "slew %d left after step", TICK_slew);
+  }
+}
+
+// Seconds are compared mod 64, corrections across that boundary take the short way
+static void testWrap(void) {
+  setClock(128, 100);                               // 128 mod 64 = 0
+  sync(127900);                                     // master 200ms behind at 63.900
+  CHECK(TICK_slew == -200, "slew %d across wrap (ahead)", TICK_slew);
+  setClock(127, 900);
+  sync(128100);                                     // master 200ms ahead at 0.100
+  CHECK(TICK_slew == 200, "slew %d across wrap (behind)", TICK_slew);
+  setClock(128, 100);
+  sync(127000);                                     // 1.1s behind across wrap -> step
+  CHECK(clockMs() == 127000, "step back across wrap gave %ld", clockMs());
+  setClock(127, 900);
+  sync(130000);                                     // 2.1s ahead across wrap -> step
+  CHECK(clockMs() == 130000, "step ahead across wrap gave %ld", clockMs());
+  setClock(65535, 999);                             // 16-bit seconds wrap as well
+  TICK_interrupt();
+  CHECK((TICK_seconds == 0) && (TICK_phase == 0), "seconds wrap gave %u.%03u",
+        TICK_seconds, TICK_phase);
+}
+
+// One hour with a crystal off by ppm, beacons every 2s with up to 8ms latency
+static void testHour(long ppm) {
+  long master, worst = 0, error;
+  long bound = labs(ppm) * 2000 / 1000000L + 1;     // drift between two beacons
+  long drift = 0;
+  setClock(0, 0);
+  srand(1);
+  for(master=1; master<=3600000L; master++) {
+    drift += ppm;                                   // slave tick early or late
+    if(drift >= 1000000L) { drift -= 1000000L; TICK_interrupt(); }
+    if(drift <= -1000000L) drift += 1000000L;       // tick missed
+    else TICK_interrupt();
+    if(!(master % 2000)) {                          // beacon sent at master time
+      uint8_t latency = rand() % 9;                 // delivered and applied later
+      long sent = master;
+      uint8_t i;
+      for(i=0; i<latency; i++) TICK_interrupt();
+      master += latency;
+      sync(sent + latency);                         // slave stamps the delay in
+    }
+    error = clockMs() - master;
+    if(master > 10000) {
+      if(error < 0) error = -error;
+      if(error > worst) worst = error;
+    }
+  }
+  CHECK(worst <= bound, "%ld ppm: worst error %ld ms after lock", ppm, worst);
+  error = clockMs() - (master - 1);                 // no second lost or gained
+  CHECK(labs(error) <= bound, "%ld ppm: %ld ms off after one hour", ppm, error);
+}
+
+int main(void) {
+  testSlew();
+  testStep();
+  testWrap();
+  testHour(0);
+  testHour(5000);
+  testHour(-5000);
+  testHour(30000);
+  if(failed) {
+    printf("tick_test: %d checks failed\n", failed);
+    return 1;
+  }
+  printf("tick_test: all checks passed\n");
+  return 0;
+}
@@ -82,9 +82,7 @@ void main(void) {
 
     buflen = CDC_available();                       // get number of bytes in CDC IN
     if(buflen) {                                    // something coming in via USB?
-      bufptr = 0;                                   // reset buffer pointer
-      if(buflen > BUFFER_SIZE) buflen = BUFFER_SIZE;// restrict length to max payload
-      while(buflen--) buffer[bufptr++] = CDC_read();// get data from CDC
+      bufptr = CDC_readBlock(buffer, BUFFER_SIZE);  // get data from CDC
       PIN_low(PIN_LED);
       
     }
@@ -29,6 +29,47 @@ volatile __bit CDC_writeBusyFlag = 0;               // flag of whether upload po
 #define SET_CONTROL_LINE_STATE  0x22  // generates RS-232/V.24 style control signals
 #define SEND_BREAK              0x23  // send break
 
+// ===================================================================================
+// Fast Copy Function
+// ===================================================================================
+// Copy len bytes from XRAM src to XRAM dst using both data pointers; the USB
+// interrupt is held off meanwhile (USB_EP0_copyDescr() uses DPTR1 as well) and
+// left as found, so callers may run with it already disabled
+#pragma callee_saves CDC_copy
+void CDC_copy(__xdata uint8_t *dst, __xdata uint8_t *src, uint8_t len) {
+  dst; src; len;                // stop unreferenced argument warning
+  __asm
+    push acc                    ; acc -> stack
+    push ar7                    ; r7  -> stack
+    push ar6                    ; r6  -> stack
+    mov  r7, _CDC_copy_PARM_3   ; r7  <- len
+    mov  a, r7
+    jz   02$                    ; nothing to copy
+    mov  r6, dpl                ; r6  <- dst low
+    mov  a, dph                 ; acc <- dst high
+    mov  c, _IE_USB             ; c   <- USB interrupt state
+    push psw                    ; c   -> stack
+    clr  _IE_USB                ; USB interrupt off
+    inc  _XBUS_AUX              ; select dptr1
+    mov  dpl, r6                ; dptr1 <- dst
+    mov  dph, a
+    dec  _XBUS_AUX              ; select dptr0
+    mov  dpl, _CDC_copy_PARM_2  ; dptr0 <- src
+    mov  dph, (_CDC_copy_PARM_2 + 1)
+    01$:
+    movx a, @dptr               ; acc <- src[dptr0]
+    inc  dptr                   ; inc dptr0
+    .db  0xA5                   ; acc -> dst[dptr1] & inc dptr1
+    djnz r7, 01$                ; repeat len times
+    pop  psw                    ; c   <- stack
+    mov  _IE_USB, c             ; USB interrupt state back
+    02$:
+    pop  ar6                    ; r6  <- stack
+    pop  ar7                    ; r7  <- stack
+    pop  acc                    ; acc <- stack
+  __endasm;
+}
+
 // ===================================================================================
 // Front End Functions
 // ===================================================================================
@@ -51,6 +92,22 @@ void CDC_write(char c) {
   if(CDC_writePointer == EP2_SIZE) CDC_flush();   // flush if buffer full
 }
 
+// Write block to OUT buffer, copies as much as fits at once, returns len
+uint8_t CDC_writeBlock(__xdata uint8_t *buf, uint8_t len) {
+  uint8_t cnt, left = len;
+  while(left) {
+    while(CDC_writeBusyFlag);                     // wait for ready to write
+    cnt = EP2_SIZE - CDC_writePointer;            // room in buffer
+    if(cnt > left) cnt = left;
+    CDC_copy(EP2_buffer + 64 + CDC_writePointer, buf, cnt); // copy block
+    CDC_writePointer += cnt;
+    buf  += cnt;
+    left -= cnt;
+    if(CDC_writePointer == EP2_SIZE) CDC_flush(); // flush if buffer full
+  }
+  return len;
+}
+
 // Write string to OUT buffer
 void CDC_print(char* str) {
   while(*str) CDC_write(*str++);                  // write each char of string
@@ -74,6 +131,21 @@ char CDC_read(void) {
   return data;
 }
 
+// Read up to max bytes from IN buffer into buf, returns number of bytes read;
+// doesn't wait and re-arms the endpoint once when the buffer is empty
+uint8_t CDC_readBlock(__xdata uint8_t *buf, uint8_t max) {
+  uint8_t len = CDC_readByteCount;                // bytes in buffer
+  if(!len) return 0;                              // nothing received
+  if(len > max) len = max;
+  CDC_copy(buf, EP2_buffer + CDC_readPointer, len); // copy block
+  CDC_readPointer += len;
+  CDC_readByteCount -= len;
+  if(!CDC_readByteCount)                          // buffer empty?
+    UEP2_CTRL = (UEP2_CTRL & ~MASK_UEP_R_RES)
+              | UEP_R_RES_ACK;                    // request new data
+  return len;
+}
+
 // ===================================================================================
 // CDC-Specific USB Handler Functions
 // ===================================================================================
@@ -8,7 +8,9 @@
 // CDC_available()          get number of bytes in the IN buffer
 // CDC_ready()              check if OUT buffer is ready to be written
 // CDC_read()               read single character from IN buffer
+// CDC_readBlock(b,n)       read up to n bytes into b, returns bytes read
 // CDC_write(c)             write single character to OUT buffer
+// CDC_writeBlock(b,n)      write n bytes of buffer b, returns n
 // CDC_writeflush(c)        write single character to OUT buffer and flush
 // CDC_print(s)             write string to OUT buffer
 // CDC_println(s)           write string with newline to OUT buffer and flush
@@ -36,7 +38,9 @@ extern volatile __bit CDC_writeBusyFlag;     // flag of whether upload pointer i
 // ===================================================================================
 void CDC_flush(void);             // flush OUT buffer
 char CDC_read(void);              // read single character from IN buffer
+uint8_t CDC_readBlock(__xdata uint8_t *buf, uint8_t max); // read block, returns length
 void CDC_write(char c);           // write single character to OUT buffer
+uint8_t CDC_writeBlock(__xdata uint8_t *buf, uint8_t len); // write block, returns length
 void CDC_print(char* str);        // write string to OUT buffer
 void CDC_println(char* str);      // write string with newline to OUT buffer and flush
 
@@ -173,17 +173,14 @@ void main(void) {
   while(1) {
     if(NRF_available()) {                           // something coming in via NRF?
       PIN_low(PIN_LED);                             // switch on LED
-      bufptr = 0;                                   // reset buffer pointer
       buflen = NRF_readPayload(buffer);             // read payload into buffer
-      while(buflen--) CDC_write(buffer[bufptr++]);  // write buffer via USB CDC
+      CDC_writeBlock(buffer, buflen);               // write buffer via USB CDC
       CDC_flush();                                  // flush CDC
     }
 
     buflen = CDC_available();                       // get number of bytes in CDC IN
     if(buflen) {                                    // something coming in via USB?
-      bufptr = 0;                                   // reset buffer pointer
-      if(buflen > NRF_PAYLOAD) buflen = NRF_PAYLOAD;// restrict length to max payload
-      while(buflen--) buffer[bufptr++] = CDC_read();// get data from CDC
+      bufptr = CDC_readBlock(buffer, NRF_PAYLOAD);  // get data from CDC
       if(buffer[0] == CMD_IDENT) parse();           // is it a command? -> parse
       else {                                        // not a command?
         PIN_low(PIN_LED);                           // switch on LED